@@ -0,0 +1,409 @@
+/*! \file bufcache.cc
+//  \brief Routines of the sector buffer cache
+//
+//      The cache is used by the disk driver for the sectors read and
+//      written with ReadSector and WriteSector. All the operations on
+//      the cache structures are done with interrupts disabled. Only a
+//      miss blocks the calling thread, while the sector is read:
+//      dirty victims are written behind without waiting.
+//
+//    Copyright (c) 1999-2000 INSA de Rennes.
+//    All rights reserved.  
+//    See copyright_insa.h for copyright notice and limitation 
+//    of liability and disclaimer of warranty provisions.
+*/
+
+#include <string.h>
+#include "kernel/system.h"
+#include "utility/config.h"
+#include "machine/interrupt.h"
+#include "machine/machine.h"
+#include "drivers/drvDisk.h"
+#include "drivers/bufcache.h"
+#include "kernel/thread.h"
+
+//----------------------------------------------------------------------
+// BufferCacheFlush
+/*! 	Timer handler of the periodic write-back. Need this to be a C
+//	routine, because C++ can't handle pointers to member functions.
+*/
+//----------------------------------------------------------------------
+
+void BufferCacheFlush(int64_t arg)
+{
+  ((BufferCache *)arg)->FlushHandler();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+/*! 	Constructor. Allocate the buffers, initially unused.
+//
+//	\param nb_buffers the number of buffers (one sector each)
+*/
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(int nb_buffers)
+{
+  this->nb_buffers = nb_buffers;
+  buffers = new CacheBuffer[nb_buffers];
+  for (int i = 0; i < nb_buffers; i++) {
+    buffers[i].disk = NULL;
+    buffers[i].sector = -1;
+    buffers[i].data = new char[g_cfg->SectorSize];
+    buffers[i].dirty = false;
+    buffers[i].referenced = false;
+    buffers[i].busy = false;
+    buffers[i].nb_waiters = 0;
+    buffers[i].ready = new Semaphore((char*)"cache buffer", 0);
+    buffers[i].stat = NULL;
+  }
+  clock_hand = 0;
+  nb_dirty = 0;
+  flush_armed = false;
+  nb_hits = nb_misses = nb_writebacks = 0;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+/*! 	Destructor. Free the buffers. The dirty sectors must have been
+//	written back and the disks drained before (see Cleanup), since
+//	this needs a running thread.
+*/
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+  for (int i = 0; i < nb_buffers; i++) {
+    delete [] buffers[i].data;
+    delete buffers[i].ready;
+  }
+  delete [] buffers;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Read
+/*! 	Copy the contents of a sector into data, reading it from the
+//	disk if it is not in the cache.
+//
+//	\param disk the disk driver of the sector
+//	\param sector the sector to read
+//	\param data the buffer to hold the contents of the sector
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::Read(DriverDisk *disk, int sector, char *data)
+{
+  IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  CacheBuffer *buffer = Lookup(disk, sector);
+  if (buffer != NULL) {
+    nb_hits++;
+    memcpy(data, buffer->data, g_cfg->SectorSize);
+    g_machine->interrupt->SetStatus(old);
+    return;
+  }
+
+  // Miss: read the sector into a new buffer. Other threads asking
+  // for the same sector wait in Lookup until it is read.
+  nb_misses++;
+  buffer = Allocate(disk, sector);
+  buffer->busy = true;
+  DiskRequest *request = disk->Submit(sector, buffer->data, false);
+  g_machine->interrupt->SetStatus(old);
+
+  disk->Wait(request);
+
+  old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  memcpy(data, buffer->data, g_cfg->SectorSize);
+  buffer->busy = false;
+  while (buffer->nb_waiters > 0) {
+    buffer->nb_waiters--;
+    buffer->ready->V();
+  }
+  g_machine->interrupt->SetStatus(old);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+/*! 	Copy the contents of consecutive sectors into a list of
+//	buffers. The sectors found in the cache are copied at once, and
+//	the missing ones are read into new buffers by a single vectored
+//	request, so that the calling thread waits for the disk once.
+//	Nothing is waited for while buffers are kept busy for the
+//	request: a sector being read by another thread, or missing
+//	while every buffer is busy, ends the request, and is then read
+//	alone.
+//
+//	\param disk the disk driver of the sectors
+//	\param sector the first sector to read
+//	\param data the buffers, one per sector
+//	\param nb the number of sectors
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSectors(DriverDisk *disk, int sector, char **data, int nb)
+{
+  CacheBuffer **missed = new CacheBuffer*[nb];
+  char **missed_data = new char*[nb];
+
+  for (int first = 0; first < nb; ) {
+    int last;
+    int nb_missed = 0;
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    for (last = first; last < nb; last++) {
+      std::map<std::pair<DriverDisk*,int>,CacheBuffer*>::iterator it
+	= index.find(std::make_pair(disk, sector + last));
+      CacheBuffer *buffer;
+      if (it != index.end()) {
+	buffer = it->second;
+	if (buffer->busy)
+	  break;
+	buffer->referenced = true;
+	nb_hits++;
+	memcpy(data[last], buffer->data, g_cfg->SectorSize);
+	missed[last] = NULL;
+	missed_data[last] = NULL;
+	continue;
+      }
+      buffer = Allocate(disk, sector + last, false);
+      if (buffer == NULL)
+	break;
+      // Other threads asking for the sector wait in Lookup until it
+      // is read
+      nb_misses++;
+      nb_missed++;
+      buffer->busy = true;
+      missed[last] = buffer;
+      missed_data[last] = buffer->data;
+    }
+
+    if (nb_missed > 0) {
+      DiskRequest *group = disk->SubmitGroup(sector + first,
+					     missed_data + first,
+					     last - first, false);
+      g_machine->interrupt->SetStatus(old);
+      disk->Wait(group);
+      old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+      for (int i = first; i < last; i++) {
+	CacheBuffer *buffer = missed[i];
+	if (buffer == NULL)
+	  continue;
+	memcpy(data[i], buffer->data, g_cfg->SectorSize);
+	buffer->busy = false;
+	while (buffer->nb_waiters > 0) {
+	  buffer->nb_waiters--;
+	  buffer->ready->V();
+	}
+      }
+    }
+    g_machine->interrupt->SetStatus(old);
+
+    // The sector which ended the request, if any, is read alone
+    if (last < nb) {
+      Read(disk, sector + last, data[last]);
+      last++;
+    }
+    first = last;
+  }
+  delete [] missed;
+  delete [] missed_data;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Write
+/*! 	Copy data into the buffer of a sector, to be written back
+//	later. The whole sector is written, so a missing sector is
+//	not read from the disk. The write-back is charged to the
+//	process of the last write.
+//
+//	\param disk the disk driver of the sector
+//	\param sector the sector to write
+//	\param data the new contents of the sector
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::Write(DriverDisk *disk, int sector, char *data)
+{
+  IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  CacheBuffer *buffer = Lookup(disk, sector);
+  if (buffer != NULL)
+    nb_hits++;
+  else
+    buffer = Allocate(disk, sector);
+
+  memcpy(buffer->data, data, g_cfg->SectorSize);
+  Process *process = (g_current_thread != NULL) ?
+    g_current_thread->GetProcessOwner() : NULL;
+  buffer->stat = (process != NULL) ? process->stat : NULL;
+  buffer->writer = (process != NULL) ? process->getName() : "kernel";
+  if (!buffer->dirty) {
+    buffer->dirty = true;
+    nb_dirty++;
+  }
+  ArmFlush();
+  g_machine->interrupt->SetStatus(old);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+/*! 	Start the write-back of all the dirty sectors. The sectors are
+//	written behind: use DriverDisk::Drain to wait for the disk.
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+  IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  for (int i = 0; i < nb_buffers && nb_dirty > 0; i++) {
+    if (buffers[i].dirty)
+      WriteBack(&buffers[i]);
+  }
+  g_machine->interrupt->SetStatus(old);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FlushHandler
+/*! 	Periodic write-back of the dirty sectors. The timer is only
+//	armed while there are dirty sectors, so that Nachos can still
+//	halt when it is idle.
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::FlushHandler()
+{
+  DEBUG('d', (char*)"[cache] periodic write-back of %d sectors\n", nb_dirty);
+  flush_armed = false;
+  Flush();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Print
+/*! 	Print the cache statistics.
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::Print()
+{
+  printf("Buffer cache: %d buffers, %d hits, %d misses, %d writebacks\n",
+	 nb_buffers, nb_hits, nb_misses, nb_writebacks);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Lookup
+/*! 	Find the buffer of a sector, waiting for it to be read if it
+//	is being read. Interrupts must be disabled.
+//
+//	\return the buffer, NULL if the sector is not in the cache
+*/
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Lookup(DriverDisk *disk, int sector)
+{
+  std::map<std::pair<DriverDisk*,int>,CacheBuffer*>::iterator it;
+
+  for (;;) {
+    it = index.find(std::make_pair(disk, sector));
+    if (it == index.end())
+      return NULL;
+    CacheBuffer *buffer = it->second;
+    if (!buffer->busy) {
+      buffer->referenced = true;
+      return buffer;
+    }
+    // Wait for the read, and look again since the buffer may have
+    // been replaced in the meantime
+    buffer->nb_waiters++;
+    buffer->ready->P();
+  }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Allocate
+/*! 	Allocate a buffer for a sector, replacing the first buffer
+//	found by the clock hand without its reference bit. A dirty
+//	victim is written behind. Interrupts must be disabled.
+//
+//	\param wait if false, give up instead of waiting when every
+//	buffer is being read
+//	\return the buffer, NULL if none is available and wait is false
+*/
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Allocate(DriverDisk *disk, int sector, bool wait)
+{
+  CacheBuffer *buffer;
+
+  for (int visited = 0;; visited++) {
+    if (visited == 2 * nb_buffers) {
+      if (!wait)
+	return NULL;
+      // Every buffer is being read: let the readers complete
+      g_current_thread->Yield();
+      visited = 0;
+    }
+    buffer = &buffers[clock_hand];
+    clock_hand = (clock_hand + 1) % nb_buffers;
+    if (buffer->busy)
+      continue;
+    if (buffer->referenced) {
+      buffer->referenced = false;
+      continue;
+    }
+    break;
+  }
+
+  if (buffer->disk != NULL) {
+    if (buffer->dirty)
+      WriteBack(buffer);
+    index.erase(std::make_pair(buffer->disk, buffer->sector));
+  }
+  buffer->disk = disk;
+  buffer->sector = sector;
+  buffer->referenced = true;
+  index[std::make_pair(disk, sector)] = buffer;
+  return buffer;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBack
+/*! 	Write a dirty buffer behind. The driver copies the data, so the
+//	buffer can be reused at once. Interrupts must be disabled.
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBack(CacheBuffer *buffer)
+{
+  buffer->disk->WriteBehind(buffer->sector, buffer->data,
+			    DISK_ORIGIN_WRITEBACK, buffer->stat,
+			    buffer->writer.c_str());
+  buffer->dirty = false;
+  nb_dirty--;
+  nb_writebacks++;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ArmFlush
+/*! 	Schedule the periodic write-back, if it is not already.
+//	Interrupts must be disabled.
+*/
+//----------------------------------------------------------------------
+
+void
+BufferCache::ArmFlush()
+{
+  if (flush_armed)
+    return;
+  flush_armed = true;
+  g_machine->interrupt->Schedule(BufferCacheFlush, (int64_t)this,
+				 BUFCACHE_FLUSH_DELAY, TIMER_INT);
+}
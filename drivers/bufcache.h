@@ -0,0 +1,93 @@
+/*! \file bufcache.h
+    \brief Data structures of the sector buffer cache
+
+    The buffer cache keeps recently used disk sectors in memory,
+    between the file system and the disk driver. Sectors are
+    identified by their disk driver and their sector number, and
+    replaced using the CLOCK algorithm. Writes are delayed: dirty
+    sectors are written back periodically, on replacement and when
+    Nachos halts.
+
+    Copyright (c) 1999-2000 INSA de Rennes.
+    All rights reserved.  
+    See copyright_insa.h for copyright notice and limitation 
+    of liability and disclaimer of warranty provisions.
+*/
+
+#ifndef BUFCACHE_H
+#define BUFCACHE_H
+
+#include <map>
+#include <string>
+#include "kernel/synch.h"
+
+class DriverDisk;
+class ProcessStat;
+
+//! Delay in ticks between two write-backs of the dirty sectors
+#define BUFCACHE_FLUSH_DELAY 10000
+
+/*! \brief Defines a sector of the buffer cache */
+typedef struct {
+  DriverDisk *disk;     //!< Disk of the sector, NULL if the buffer is unused
+  int sector;           //!< Sector number
+  char *data;           //!< Contents of the sector
+  bool dirty;           //!< Modified since last written to disk
+  bool referenced;      //!< Used since last visited by the clock hand
+  bool busy;            //!< Being read from the disk
+  int nb_waiters;       //!< Number of threads waiting for the read
+  Semaphore *ready;     //!< V'ed when the read is complete
+  ProcessStat *stat;    //!< Statistics of the last writer (NULL: kernel)
+  std::string writer;   //!< Name of the last writer, charged the write-back
+} CacheBuffer;
+
+/*! \brief Defines the sector buffer cache */
+class BufferCache {
+public:
+  //! Constructor. Allocate nb_buffers buffers of one sector
+  BufferCache(int nb_buffers);
+
+  //! Destructor. Free the buffers (flushed and drained before)
+  ~BufferCache();
+
+  //! Read a sector through the cache
+  void Read(DriverDisk *disk, int sector, char *data);
+
+  //! Read consecutive sectors through the cache, the missing ones
+  //! as a single disk request
+  void ReadSectors(DriverDisk *disk, int sector, char **data, int nb);
+
+  //! Write a sector through the cache (written back later)
+  void Write(DriverDisk *disk, int sector, char *data);
+
+  //! Start the write-back of all the dirty sectors
+  void Flush();
+
+  //! Periodic write-back, run from the timer (interrupt time)
+  void FlushHandler();
+
+  //! Print the cache statistics
+  void Print();
+
+private:
+  CacheBuffer *Lookup(DriverDisk *disk, int sector);
+  CacheBuffer *Allocate(DriverDisk *disk, int sector, bool wait = true);
+  void WriteBack(CacheBuffer *buffer);
+  void ArmFlush();
+
+  CacheBuffer *buffers;       //!< The buffers
+  int nb_buffers;             //!< Number of buffers
+  int clock_hand;             //!< Next buffer visited for replacement
+  std::map<std::pair<DriverDisk*,int>,CacheBuffer*> index;
+                              //!< Buffer of each cached sector
+  int nb_dirty;               //!< Number of dirty buffers
+  bool flush_armed;           //!< A periodic write-back is scheduled
+
+  int nb_hits;                //!< Number of accesses found in the cache
+  int nb_misses;              //!< Number of reads from the disk
+  int nb_writebacks;          //!< Number of sectors written back
+};
+
+void BufferCacheFlush(int64_t arg);
+
+#endif // BUFCACHE_H
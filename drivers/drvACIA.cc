@@ -21,18 +21,37 @@
 
 #include "kernel/system.h"         // for the ACIA object
 #include "kernel/synch.h"
+#include "kernel/scheduler.h"
 #include "machine/ACIA.h"
 #include "drivers/drvACIA.h"
+#include "utility/stats.h"
+
+//-------------------------------------------------------------------------
+// FrameHeader(char* header, int len)
+/*! Build the header of the frame of a message of len bytes: start
+  marker, length and check byte of the length.
+  */
+//-------------------------------------------------------------------------
+
+static void FrameHeader(char* header, int len) {
+    int hi = (len >> 8) & 0xff;
+    int lo = len & 0xff;
+    header[0] = (char)FRAME_START;
+    header[1] = (char)hi;
+    header[2] = (char)lo;
+    header[3] = (char)FRAME_CHECK(hi, lo);
+}
 
 //-------------------------------------------------------------------------
 // DriverACIA::DriverACIA()
 /*! Constructor.
   Initialize the ACIA driver.
   In the ACIA Interrupt mode,
-  initialize the reception index and semaphores and allow
-  reception interrupts.
+  initialize the send and receive rings and semaphores and
+  allow reception interrupts.
   In the ACIA Busy Waiting mode, simply initialize the ACIA
-  working mode and create the semaphore.
+  working mode and create the semaphores: the chars are sent and
+  received by polling the ACIA.
   */
 //-------------------------------------------------------------------------
 
@@ -42,15 +61,46 @@ DriverACIA::DriverACIA() {
     exit(-1);
 #endif
 #ifdef ETUDIANTS_TP
-    if (g_cfg->ACIA == ACIA_INTERRUPT) {
-        send_sema = new Semaphore("send_sema", 1);
-        receive_sema = new Semaphore("receive_sema", 0);
-        ind_send = 1;
-        ind_rec = 0;
+    send_head = 0;
+    send_count = 0;
+    sending = false;
+    send_waiting = false;
+    send_partial = false;
+    send_depth = max_send_depth = 0;
+    nb_msg_sent = nb_char_sent = 0;
+    send_busy = send_start = 0;
+    send_frame_state = 0;
+    send_frame_left = 0;
+    receive_head = 0;
+    receive_count = 0;
+    receive_partial = 0;
+    receive_frame_state = 0;
+    receive_frame_left = 0;
+    receive_dropping = false;
+    nb_frame_errors = nb_chars_skipped = 0;
+    receive_handler = NULL;
+    receive_depth = max_receive_depth = 0;
+    nb_msg_received = nb_msg_dropped = 0;
+    send_end = 0;
+    nb_send_interrupts = nb_receive_interrupts = 0;
+    nb_polls = 0;
+    poll_busy = 0;
+    nb_msg_polled = nb_poll_fallbacks = 0;
+    nb_delivered = 0;
+    sum_latency = max_latency = 0;
+    send_sema = new Semaphore((char*)"send_sema", 0);
+    receive_sema = new Semaphore((char*)"receive_sema", 0);
+    send_lock = new Lock((char*)"send_lock");
+    receive_lock = new Lock((char*)"receive_lock");
+    busy_waiting = (g_cfg->ACIA == ACIA_BUSY_WAITING);
+    if (!busy_waiting) {
+        poll_ticks = (g_cfg->AciaPollTicks > 0) ? g_cfg->AciaPollTicks : 0;
         g_machine->acia->SetWorkingMode(REC_INTERRUPT | SEND_INTERRUPT);
-        DEBUG('i', "ACIA Driver initialized in INTERRUPT mode.\n");
+        DEBUG('i', (char*)"ACIA Driver initialized in INTERRUPT mode.\n");
     } else {
-
+        poll_ticks = 0;
+        g_machine->acia->SetWorkingMode(BUSY_WAITING);
+        DEBUG('i', (char*)"ACIA Driver initialized in BUSY WAITING mode.\n");
     }
 #endif
 }
@@ -58,6 +108,8 @@ DriverACIA::DriverACIA() {
 //-------------------------------------------------------------------------
 // DriverACIA::TtySend(char* buff)
 /*! Routine to send a message through the ACIA (Busy Waiting or Interrupt mode)
+  The message is the string buff, without its '\0'.
+  \return the number of chars of the message
   */
 //-------------------------------------------------------------------------
 
@@ -69,25 +121,158 @@ int DriverACIA::TtySend(char* buff) {
     return 0;
 #endif
 #ifdef ETUDIANTS_TP
-    DEBUG('i', "Call to TtySend\n");
-    send_sema->P();
-    int i = 0;
-    // copying the line into the emission buffer
-    do {
-        send_buffer[i] = buff[i];
-        i++;
-    } while (buff[i-1] != '\0');
-    // sending the first character
-    ind_send = 0;
-    //printf("Sending : %c\n", send_buffer[0]);
-    g_machine->acia->PutChar(send_buffer[0]);
+    DEBUG('i', (char*)"Call to TtySend\n");
+    return SendMessage(buff, strlen(buff));
 #endif
 }
 
+//-------------------------------------------------------------------------
+// DriverACIA::SendMessage(char* buff, int len)
+/*! Routine to send a message of len bytes, which may contain any
+  byte, through the ACIA.
+  In the Interrupt mode, the frame of the message is copied into the
+  send ring, and the routine returns as soon as it is queued: it only
+  waits when the ring is full. The frames are sent in order by the
+  emission interrupt handler.
+  In the Busy Waiting mode, the routine sends the frame itself,
+  polling the ACIA before each char.
+  \return the number of chars of the message, -1 if it is too long
+  */
+//-------------------------------------------------------------------------
+
+int DriverACIA::SendMessage(char* buff, int len) {
+    if ((len < 0) || (len > ACIA_MAX_MSG))
+        return -1;
+    char header[FRAME_HEADER_SIZE];
+    FrameHeader(header, len);
+
+    if (busy_waiting) {
+        // the sender may be preempted while polling: the lock keeps
+        // the frame whole
+        send_lock->Acquire();
+        IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+        Time start = g_stats->getTotalTicks();
+        for (int i = 0; i < FRAME_HEADER_SIZE; i++)
+            PollSendChar(header[i]);
+        for (int i = 0; i < len; i++)
+            PollSendChar(buff[i]);
+        send_end = g_stats->getTotalTicks();
+        send_busy += send_end - start;
+        nb_msg_sent++;
+        g_machine->interrupt->SetStatus(old);
+        send_lock->Release();
+        return len;
+    }
+
+    // only one frame at a time is copied into the ring, so that
+    // frames larger than the free room are not mixed
+    send_lock->Acquire();
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    send_depth++;
+    if (send_depth > max_send_depth) max_send_depth = send_depth;
+    g_machine->interrupt->SetStatus(old);
+    send_partial = true;
+    PutInSendRing(header, FRAME_HEADER_SIZE);
+    PutInSendRing(buff, len);
+    send_partial = false;
+    send_lock->Release();
+    return len;
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::SendMessageNow(char* buff, int len)
+/*! Queue a message without ever blocking: the frame is copied into
+  the send ring only if it fits entirely, and if no other frame is
+  being copied. May be called from interrupt handlers, in the
+  Interrupt mode only.
+  \return true if the message was queued
+  */
+//-------------------------------------------------------------------------
+
+bool DriverACIA::SendMessageNow(char* buff, int len) {
+    if ((len < 0) || (len > ACIA_MAX_MSG))
+        return false;
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    if (send_partial
+        || (send_count + FRAME_HEADER_SIZE + len > SEND_RING_SIZE)) {
+        g_machine->interrupt->SetStatus(old);
+        return false;
+    }
+    char header[FRAME_HEADER_SIZE];
+    FrameHeader(header, len);
+    send_depth++;
+    if (send_depth > max_send_depth) max_send_depth = send_depth;
+    PutInSendRing(header, FRAME_HEADER_SIZE);
+    PutInSendRing(buff, len);
+    g_machine->interrupt->SetStatus(old);
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::SetReceiveHandler(AciaReceiveHandler handler)
+/*! Pass each message to handler as soon as it is received, at
+  interrupt time, instead of queueing it for TtyReceive. Used by the
+  kernel protocols built on the serial line.
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::SetReceiveHandler(AciaReceiveHandler handler) {
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    receive_handler = handler;
+    // deliver the messages already received
+    if (handler != NULL) {
+        char msg[ACIA_MAX_MSG];
+        while (receive_depth > 0) {
+            receive_sema->P();
+            int len = GetFromReceiveRing(msg, ACIA_MAX_MSG);
+            receive_times.pop_front();
+            handler(msg, len);
+        }
+    }
+    g_machine->interrupt->SetStatus(old);
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::PutInSendRing(const char* data, int len)
+/*! Copy chars into the send ring, waiting for room when it is full,
+  and start sending if the ACIA is idle. send_lock must be held, or
+  interrupts disabled with enough room in the ring.
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::PutInSendRing(const char* data, int len) {
+    int i = 0;
+    while (i < len) {
+        IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+        while (send_count == SEND_RING_SIZE) {
+            send_waiting = true;
+            send_sema->P();
+        }
+        for (; (i < len) && (send_count < SEND_RING_SIZE); i++) {
+            send_ring[(send_head + send_count) % SEND_RING_SIZE] = data[i];
+            send_count++;
+        }
+        if (!sending) {
+            sending = true;
+            send_start = g_stats->getTotalTicks();
+            g_machine->acia->PutChar(send_ring[send_head]);
+        }
+        g_machine->interrupt->SetStatus(old);
+    }
+}
+
 //-------------------------------------------------------------------------
 // DriverACIA::TtyReceive(char* buff,int length)
 /*! Routine to reveive a message through the ACIA
 //  (Busy Waiting and Interrupt mode).
+//  In the Interrupt mode, the first complete message of the receive
+//  ring is dequeued, waiting for one if the ring is empty. Only its
+//  first lg chars are copied, the rest is lost.
+//  In the Busy Waiting mode, the ACIA is polled until a message is
+//  complete. In the hybrid mode, it is polled if a message was sent
+//  less than AciaPollTicks ago, until the reply arrives or the poll
+//  time is over; the reception interrupts are then used again.
+//  \return the number of chars copied into buff
   */
 //-------------------------------------------------------------------------
 
@@ -99,22 +284,56 @@ int DriverACIA::TtyReceive(char* buff,int lg) {
     return 0;
 #endif
 #ifdef ETUDIANTS_TP
-    DEBUG('i', "Call to TtyReceive\n");
-    receive_sema->P();
-    int borne = lg;//min(lg, ind_rec);
-    for (int i=0; i<borne ; i++) {
-        buff[i] = receive_buffer[i];
-    }
-    //buff[borne-1] = '\0';
-    ind_rec = 0;
+    DEBUG('i', (char*)"Call to TtyReceive\n");
+    receive_lock->Acquire();
+    if (busy_waiting)
+        PollReceive(false);
+    else if (poll_ticks > 0)
+        PollReceive(true);
+    receive_sema->P();    // wait for a complete frame
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    int copied = GetFromReceiveRing(buff, lg);
+    Time latency = g_stats->getTotalTicks() - receive_times.front();
+    receive_times.pop_front();
+    nb_delivered++;
+    sum_latency += latency;
+    if (latency > max_latency) max_latency = latency;
+    g_machine->interrupt->SetStatus(old);
+    receive_lock->Release();
+    return copied;
 #endif
 }
 
+//-------------------------------------------------------------------------
+// DriverACIA::GetFromReceiveRing(char* buff, int lg)
+/*! Dequeue the first complete frame of the receive ring, copying at
+  most lg chars of its message into buff. Interrupts must be
+  disabled, and a frame must be in the ring.
+  \return the number of chars copied into buff
+  */
+//-------------------------------------------------------------------------
+
+int DriverACIA::GetFromReceiveRing(char* buff, int lg) {
+    int len = ((receive_ring[(receive_head + 1) % RECEIVE_RING_SIZE] & 0xff) << 8)
+      | (receive_ring[(receive_head + 2) % RECEIVE_RING_SIZE] & 0xff);
+    int copied = (len < lg) ? len : lg;
+    for (int i = 0; i < copied; i++) {
+        buff[i] = receive_ring[(receive_head + FRAME_HEADER_SIZE + i)
+                               % RECEIVE_RING_SIZE];
+    }
+    receive_head = (receive_head + FRAME_HEADER_SIZE + len) % RECEIVE_RING_SIZE;
+    receive_count -= FRAME_HEADER_SIZE + len;
+    receive_depth--;
+    return copied;
+}
+
 //-------------------------------------------------------------------------
 // DriverACIA::InterruptSend()
 /*! Emission interrupt handler.
   Used in the ACIA Interrupt mode only.
-  Detects when it's the end of the message (if so, releases the send_sema semaphore), else sends the next character according to index ind_send.
+  Removes the char just sent from the send ring, and sends the next
+  one if any. Releases the send_sema semaphore if a sender waits for
+  room in the ring.
   */
 //-------------------------------------------------------------------------
 
@@ -124,11 +343,42 @@ void DriverACIA::InterruptSend() {
     exit(-1);
 #endif
 #ifdef ETUDIANTS_TP
-    if (send_buffer[ind_send] != '\0') {
-        ind_send++;
-        //printf("Sending : %c %d\n", send_buffer[ind_send], send_buffer[ind_send]);
-        g_machine->acia->PutChar(send_buffer[ind_send]);
+    nb_send_interrupts++;
+    char sent = send_ring[send_head];
+    send_head = (send_head + 1) % SEND_RING_SIZE;
+    send_count--;
+    nb_char_sent++;
+    // follow the frames, to count the messages sent
+    bool frame_end = false;
+    if (send_frame_state == 0) {
+        send_frame_state = 1;       // start marker
+    } else if (send_frame_state == 1) {
+        send_frame_left = (sent & 0xff) << 8;
+        send_frame_state = 2;
+    } else if (send_frame_state == 2) {
+        send_frame_left |= (sent & 0xff);
+        send_frame_state = 3;
+    } else if (send_frame_state == 3) {
+        send_frame_state = 4;       // check byte
+        frame_end = (send_frame_left == 0);
+    } else {
+        send_frame_left--;
+        frame_end = (send_frame_left == 0);
+    }
+    if (frame_end) {
+        send_frame_state = 0;
+        send_depth--;
+        nb_msg_sent++;
+    }
+    if (send_count > 0) {
+        g_machine->acia->PutChar(send_ring[send_head]);
     } else {
+        sending = false;
+        send_end = g_stats->getTotalTicks();
+        send_busy += send_end - send_start;
+    }
+    if (send_waiting) {
+        send_waiting = false;
         send_sema->V();
     }
 #endif
@@ -137,10 +387,8 @@ void DriverACIA::InterruptSend() {
 //-------------------------------------------------------------------------
 // DriverACIA::Interrupt_receive()
 /*! Reception interrupt handler.
-  Used in the ACIA Interrupt mode only. Reveices a character through the ACIA.
-  Releases the receive_sema semaphore and disables reception
-  interrupts when the last character of the message is received
-  (character '\0').
+  Used in the ACIA Interrupt mode only. Reveices a character through the ACIA
+  and stores it in the receive ring.
   */
 //-------------------------------------------------------------------------
 
@@ -150,12 +398,200 @@ void DriverACIA::InterruptReceive() {
     exit(-1);
 #endif
 #ifdef ETUDIANTS_TP
-    //printf("Receive : %c %d\n", receive_buffer[ind_rec], receive_buffer[ind_rec]);
-    receive_buffer[ind_rec] = g_machine->acia->GetChar();
-    if (receive_buffer[ind_rec] == '\0') {
-        receive_sema->V();
+    nb_receive_interrupts++;
+    ReceiveChar(g_machine->acia->GetChar());
+#endif
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::ReceiveChar(char c)
+/*! Store a char received in the receive ring, following the frames.
+  Releases the receive_sema semaphore when the last character of a
+  frame is received, or passes the message to the receive handler
+  if one is set. A frame that does not fit in the ring is dropped.
+  Between frames, the chars are skipped until a start marker; a frame
+  whose header is not valid is dropped, and the next marker is looked
+  for from the char following it. Interrupts must be disabled.
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::ReceiveChar(char c) {
+    bool frame_end = false;
+    if (receive_frame_state == 0) {
+        if ((c & 0xff) != FRAME_START) {
+            nb_chars_skipped++;
+            return;
+        }
+        receive_frame_state = 1;
+        receive_dropping = false;
+    } else if (receive_frame_state == 1) {
+        receive_frame_left = (c & 0xff) << 8;
+        receive_frame_state = 2;
+    } else if (receive_frame_state == 2) {
+        receive_frame_left |= (c & 0xff);
+        receive_frame_state = 3;
+    } else if (receive_frame_state == 3) {
+        int hi = (receive_frame_left >> 8) & 0xff;
+        int lo = receive_frame_left & 0xff;
+        if (((c & 0xff) != FRAME_CHECK(hi, lo))
+            || (receive_frame_left > ACIA_MAX_MSG)) {
+            DEBUG('i', (char*)"ACIA bad frame header, frame dropped\n");
+            nb_frame_errors++;
+            receive_frame_state = 0;
+            if (!receive_dropping)
+                receive_partial = 0;
+            return;
+        }
+        receive_frame_state = 4;
+        frame_end = (receive_frame_left == 0);
     } else {
-        ind_rec++;
+        receive_frame_left--;
+        frame_end = (receive_frame_left == 0);
     }
-#endif
+
+    // store the char after the complete frames and the chars already
+    // received of this one
+    if (!receive_dropping) {
+        if (receive_count + receive_partial == RECEIVE_RING_SIZE) {
+            DEBUG('i', (char*)"ACIA receive ring full, frame dropped\n");
+            receive_dropping = true;
+            receive_partial = 0;
+            nb_msg_dropped++;
+        } else {
+            receive_ring[(receive_head + receive_count + receive_partial)
+                         % RECEIVE_RING_SIZE] = c;
+            receive_partial++;
+        }
+    }
+
+    if (frame_end) {
+        receive_frame_state = 0;
+        if (!receive_dropping) {
+            receive_count += receive_partial;
+            receive_partial = 0;
+            receive_depth++;
+            if (receive_depth > max_receive_depth)
+                max_receive_depth = receive_depth;
+            nb_msg_received++;
+            if (receive_handler != NULL) {
+                char msg[ACIA_MAX_MSG];
+                int len = GetFromReceiveRing(msg, ACIA_MAX_MSG);
+                receive_handler(msg, len);
+            } else {
+                receive_times.push_back(g_stats->getTotalTicks());
+                receive_sema->V();
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::PollSendChar(char c)
+/*! Send a char, polling the ACIA until its output register is empty.
+  Interrupts must be disabled.
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::PollSendChar(char c) {
+    while (g_machine->acia->GetOutputStateReg() == FULL)
+        PollWait(true);
+    g_machine->acia->PutChar(c);
+    nb_char_sent++;
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::PollReceive(bool bounded)
+/*! Receive chars by polling the ACIA input register, until a message
+  is complete in the receive ring.
+  \param bounded if true (hybrid mode), only poll if a message was
+  sent less than poll_ticks ago, and until poll_ticks after it was
+  sent. The reception interrupts are disabled while polling, so the
+  CPU is not given up meanwhile: the chars would be lost.
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::PollReceive(bool bounded) {
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    Time deadline = (sending ? g_stats->getTotalTicks() : send_end) + poll_ticks;
+    if (bounded && ((receive_depth > 0)
+                    || (g_stats->getTotalTicks() >= deadline))) {
+        g_machine->interrupt->SetStatus(old);
+        return;
+    }
+    if (bounded)
+        g_machine->acia->SetWorkingMode(SEND_INTERRUPT);
+    while ((receive_depth == 0)
+           && (!bounded || (g_stats->getTotalTicks() < deadline))) {
+        if (g_machine->acia->GetInputStateReg() == FULL)
+            ReceiveChar(g_machine->acia->GetChar());
+        else
+            PollWait(!bounded);
+    }
+    if (bounded) {
+        // a char may have arrived during the last wait
+        if (g_machine->acia->GetInputStateReg() == FULL)
+            ReceiveChar(g_machine->acia->GetChar());
+        g_machine->acia->SetWorkingMode(REC_INTERRUPT | SEND_INTERRUPT);
+        if (receive_depth > 0)
+            nb_msg_polled++;
+        else
+            nb_poll_fallbacks++;
+    }
+    g_machine->interrupt->SetStatus(old);
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::PollWait(bool preemptible)
+/*! Let the time advance to the next pending interrupt while polling
+  the ACIA: the ticks spent there are the CPU cost of polling. The
+  CPU is given to another thread only if an interrupt handler asked
+  for a preemption (Interrupt::Idle does not yield by itself).
+  Interrupts must be disabled.
+  \param preemptible false if the CPU must not be given up
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::PollWait(bool preemptible) {
+    Time start = g_stats->getTotalTicks();
+    g_machine->interrupt->Idle();
+    nb_polls++;
+    poll_busy += g_stats->getTotalTicks() - start;
+    if (preemptible)
+        g_scheduler->CheckPreemption();
+}
+
+//-------------------------------------------------------------------------
+// DriverACIA::Print()
+/*! Print the statistics of the driver: messages and chars sent,
+  maximum number of messages queued, throughput while sending
+  (chars per 1000 ticks), and messages received and dropped.
+  For the working mode: the interrupts taken and the time spent
+  polling (CPU cost), and the delay between the arrival of a message
+  and its delivery by TtyReceive (latency).
+  */
+//-------------------------------------------------------------------------
+
+void DriverACIA::Print() {
+    printf("ACIA send: %d messages, %d chars, max queue %d messages, "
+           "throughput %.2f chars/1000 ticks\n",
+           nb_msg_sent, nb_char_sent, max_send_depth,
+           send_busy ? (1000.0 * nb_char_sent) / send_busy : 0.0);
+    printf("ACIA receive: %d messages, %d dropped, max queue %d messages, "
+           "%d bad frames, %d chars skipped\n",
+           nb_msg_received, nb_msg_dropped, max_receive_depth,
+           nb_frame_errors, nb_chars_skipped);
+    const char *mode = busy_waiting ? "busy waiting"
+      : (poll_ticks > 0) ? "hybrid" : "interrupt";
+    printf("ACIA mode %s: %d send interrupts, %d receive interrupts, "
+           "%d polls, %lld ticks polling\n",
+           mode, nb_send_interrupts, nb_receive_interrupts,
+           nb_polls, (long long)poll_busy);
+    if (poll_ticks > 0)
+        printf("ACIA hybrid mode: poll %lld ticks after a send, "
+               "%d messages polled, %d fallbacks to interrupts\n",
+               (long long)poll_ticks, nb_msg_polled, nb_poll_fallbacks);
+    printf("ACIA delivery latency: %d messages, mean %.1f ticks, "
+           "max %lld ticks\n", nb_delivered,
+           nb_delivered ? (double)sum_latency / nb_delivered : 0.0,
+           (long long)max_latency);
 }
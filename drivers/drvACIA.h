@@ -10,6 +10,9 @@
         mode implements a synchronous IO whereas IOs are asynchronous
         IOs are implemented in the Interrupt mode (see the Nachos
         roadmap for further details).
+        In the Interrupt mode, the driver may also poll the ACIA for
+        a few ticks after a send, when a reply is expected (hybrid
+        mode, AciaPollTicks in the configuration).
   
     Copyright (c) 1999-2000 INSA de Rennes.
     All rights reserved.  
@@ -22,9 +25,26 @@
 
 /* Includes */
 
+#include <deque>
 #include "kernel/synch.h"	// for the acces to the synchronisation's tools
 
-#define BUFFER_SIZE 256  // size of emission and reception buffers
+#define SEND_RING_SIZE 1024  // size of the ring of messages to send
+#define RECEIVE_RING_SIZE 4096  // size of the ring of messages received
+#define ACIA_MAX_MSG 1024  // maximum size of a message
+
+// On the line, each message is sent as a frame: a start marker, its
+// length on two bytes (most significant first), a check byte of the
+// length, followed by its bytes. A header with a bad check byte or a
+// length over ACIA_MAX_MSG drops the frame, and the receiver looks for
+// the next marker, so that a lost or corrupted byte only loses the
+// frames around it.
+#define FRAME_START 0x7e
+#define FRAME_HEADER_SIZE 4
+#define FRAME_CHECK(hi, lo) ((~((hi) ^ (lo))) & 0xff)
+
+//! Routine called with each message received, when the messages are
+//! consumed by a kernel protocol instead of TtyReceive
+typedef void (*AciaReceiveHandler)(char* msg, int len);
 
 /*! The class DriverACIA defines the handler of the ACIA. It is the
 system's interface between the user programs and the ACIA (simulated) hardware.*/
@@ -33,13 +53,73 @@ system's interface between the user programs and the ACIA (simulated) hardware.*
 class DriverACIA{
 
  private:
-  char send_buffer[BUFFER_SIZE];        //!< system buffer for emission
-  char receive_buffer[BUFFER_SIZE];     //!< system buffer for reception
-  Semaphore* send_sema;  //!< semaphore used to synchronize emission requests
-  Semaphore* receive_sema; //!< semaphore used to synchronize reception requests
+  char send_ring[SEND_RING_SIZE];       //!< ring of the frames to send
+  char receive_ring[RECEIVE_RING_SIZE]; //!< ring of the frames received
+  Semaphore* send_sema;  //!< semaphore used to wait for room in the ring
+  Semaphore* receive_sema; //!< counts the complete frames received
+  Lock* send_lock;       //!< keeps the messages whole in the ring
+  Lock* receive_lock;    //!< one receiver at a time dequeues a frame
   
-  int ind_send; //!< index in the emission buffer
-  int ind_rec;  //!< index in the reception buffer
+  int send_head;  //!< index of the next char to send in the ring
+  int send_count; //!< number of chars in the ring
+  bool sending;   //!< a char is being sent by the ACIA
+  bool send_waiting; //!< a sender waits for room in the ring
+  bool send_partial; //!< a frame is partially copied into the ring
+  int send_frame_state; //!< position in the frame being sent
+  int send_frame_left;  //!< bytes left in the frame being sent
+
+  int receive_head;   //!< index of the first frame in the ring
+  int receive_count;  //!< number of chars of the complete frames
+  int receive_partial; //!< number of chars of the frame being received
+  int receive_frame_state; //!< position in the frame being received
+  int receive_frame_left;  //!< bytes left in the frame being received
+  bool receive_dropping;   //!< the frame being received is dropped
+  int nb_frame_errors;     //!< number of bad headers (frames dropped)
+  int nb_chars_skipped;    //!< number of chars skipped to find a marker
+  AciaReceiveHandler receive_handler; //!< consumer of the messages, or NULL
+
+  int send_depth;     //!< number of messages in the ring
+  int max_send_depth; //!< maximum of send_depth
+  int nb_msg_sent;    //!< number of messages sent
+  int nb_char_sent;   //!< number of chars sent
+  Time send_busy;     //!< ticks spent sending
+  Time send_start;    //!< start of the current sending period
+  int receive_depth;      //!< number of complete frames in the ring
+  int max_receive_depth;  //!< maximum of receive_depth
+  int nb_msg_received;    //!< number of messages received
+  int nb_msg_dropped;     //!< number of messages dropped (ring full)
+
+  bool busy_waiting;      //!< Busy Waiting mode (Interrupt mode otherwise)
+  Time poll_ticks;        //!< hybrid mode: ticks polled after a send
+  Time send_end;          //!< tick the last message was sent
+  std::deque<Time> receive_times; //!< tick each queued message arrived
+  int nb_send_interrupts; //!< number of emission interrupts
+  int nb_receive_interrupts; //!< number of reception interrupts
+  int nb_polls;           //!< number of times the ACIA was polled
+  Time poll_busy;         //!< ticks spent polling the ACIA
+  int nb_msg_polled;      //!< hybrid mode: messages received by polling
+  int nb_poll_fallbacks;  //!< hybrid mode: polls ended by the deadline
+  int nb_delivered;       //!< number of messages returned by TtyReceive
+  Time sum_latency;       //!< sum of the delays from arrival to delivery
+  Time max_latency;       //!< maximum of these delays
+
+  //! Copy chars into the send ring, waiting for room if needed
+  void PutInSendRing(const char* data, int len);
+
+  //! Dequeue the first complete frame of the receive ring
+  int GetFromReceiveRing(char* buff, int lg);
+
+  //! Store a char received in the receive ring
+  void ReceiveChar(char c);
+
+  //! Send a char, waiting for the ACIA by polling it
+  void PollSendChar(char c);
+
+  //! Receive chars by polling the ACIA until a message is complete
+  void PollReceive(bool bounded);
+
+  //! Let the time advance while polling the ACIA
+  void PollWait(bool preemptible);
     
  public:
   //! Constructor. Driver initialization.
@@ -48,6 +128,16 @@ class DriverACIA{
   //! Send a message through the ACIA
   int TtySend(char* buff);
   
+  //! Send a message of len bytes (possibly binary) through the ACIA
+  int SendMessage(char* buff, int len);
+
+  //! Queue a message at once if its frame fits in the send ring.
+  //! May be called from interrupt handlers
+  bool SendMessageNow(char* buff, int len);
+
+  //! Pass the messages received to handler instead of queueing them
+  void SetReceiveHandler(AciaReceiveHandler handler);
+
   //! Receive a message using the ACIA 
   int TtyReceive(char* buff,int lg);
   
@@ -56,6 +146,9 @@ class DriverACIA{
   
   //! Reception interrupt handler. Used in the ACIA Interrupt mode only
   void InterruptReceive();
+
+  //! Print the statistics of the driver
+  void Print();
 };
 #endif // _ACIA_HDL
 
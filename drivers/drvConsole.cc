@@ -26,6 +26,24 @@
 
 //
 
+//      The output is buffered: writers copy their characters into a
+
+//      ring buffer and only wait when it is full, while the write
+
+//      interrupt handler sends the buffered characters one by one.
+
+//
+
+//      The input is buffered too: the read interrupt handler fills
+
+//      an input ring buffer at all times, so that typed characters
+
+//      are not lost, and wakes up the reader only once its request
+
+//      can be served.
+
+//
+
 //  Copyright (c) 1992-1993 The Regents of the University of California.
 
 //  All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -104,6 +122,30 @@ DriverConsole::DriverConsole(){
 
   mutexput = new Lock((char*)"mutex put");
 
+  out_head = 0;
+
+  out_count = 0;
+
+  out_busy = false;
+
+  out_waiting = false;
+
+  in_head = 0;
+
+  in_count = 0;
+
+  in_lines = 0;
+
+  in_wanted = 0;
+
+  in_lost = 0;
+
+  canonical = true;
+
+  in_enabled = true;
+
+  g_machine->console->EnableInterrupt();
+
 }
 
 
@@ -116,9 +158,9 @@ DriverConsole::DriverConsole(){
 
 /*!     Destructor.
 
-//      De-allocate data structures needed by the console driver
+//      Send the buffered output, then de-allocate data structures
 
-//      (semaphores, locks).
+//      needed by the console driver (semaphores, locks).
 
 */
 
@@ -126,6 +168,10 @@ DriverConsole::DriverConsole(){
 
 DriverConsole::~DriverConsole() {
 
+  Flush();
+
+  DisableInput();
+
   delete mutexget;
 
   delete mutexput;
@@ -144,7 +190,11 @@ DriverConsole::~DriverConsole() {
 
 // DriverConsole::PutAChar
 
-/*!     Operate a V on the "write" semaphore to signal a char is written.
+/*!     Remove the char just written from the output buffer, and send
+
+//      the next one if any. Operate a V on the "write" semaphore if
+
+//      a writer waits for free space.
 
 //      The method is called by the interrupt handler ConsolePut.
 
@@ -158,7 +208,25 @@ void DriverConsole::PutAChar(){
 
   IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
 
-  put->V();
+  out_head = (out_head + 1) % CONSOLE_OUT_SIZE;
+
+  out_count--;
+
+  if (out_count > 0)
+
+    g_machine->console->PutChar(out_buffer[out_head]);
+
+  else
+
+    out_busy = false;
+
+  if (out_waiting) {
+
+    out_waiting = false;
+
+    put->V();
+
+  }
 
   (void) g_machine->interrupt->SetStatus(oldLevel);
 
@@ -174,9 +242,13 @@ void DriverConsole::PutAChar(){
 
 /*!     Send a string to the console device using a lock to insure
 
-//      mutual exclusion. The method returns when all characters 
+//      mutual exclusion, so that the strings are not mixed. The
+
+//      characters are copied into the output buffer, and the method
 
-//      has been sent.
+//      returns when they all are queued: it only waits when the
+
+//      buffer is full.
 
 // 
 
@@ -196,13 +268,39 @@ void DriverConsole::PutString(char *buffer,int nbcar) {
 
 
 
-  for (int i=0;i<nbcar;i++) {
+  int i = 0;
+
+  while (i < nbcar) {
+
+    IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+    while (out_count == CONSOLE_OUT_SIZE) {
+
+      out_waiting = true;
 
-    g_current_thread->GetProcessOwner()->stat->incrNumCharWritten();
+      put->P();
 
-    g_machine->console->PutChar(buffer[i]);
+    }
 
-    put->P();
+    for (; (i < nbcar) && (out_count < CONSOLE_OUT_SIZE); i++) {
+
+      g_current_thread->GetProcessOwner()->stat->incrNumCharWritten();
+
+      out_buffer[(out_head + out_count) % CONSOLE_OUT_SIZE] = buffer[i];
+
+      out_count++;
+
+    }
+
+    if (!out_busy) {
+
+      out_busy = true;
+
+      g_machine->console->PutChar(out_buffer[out_head]);
+
+    }
+
+    (void) g_machine->interrupt->SetStatus(oldLevel);
 
   }
 
@@ -214,11 +312,45 @@ void DriverConsole::PutString(char *buffer,int nbcar) {
 
 
 
+//-----------------------------------------------------------------
+
+// DriverConsole::Flush
+
+/*!     Wait until all the buffered output has been sent. The
+
+//      simulated time is advanced without switching threads, so
+
+//      this can be used when Nachos halts.
+
+*/
+
+//-----------------------------------------------------------------
+
+void DriverConsole::Flush() {
+
+
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  while (out_count > 0)
+
+    g_machine->interrupt->Idle();
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+
+}
+
+
+
 //-----------------------------------------------------------------
 
 // DriverConsole::GetAChar
 
-/*!     Operate a V on the "read" semaphore to signal a char is read.
+/*!     Store the char received in the input buffer (it is dropped if
+
+//      the buffer is full), and operate a V on the "read" semaphore
+
+//      if the waiting reader can be served.
 
 //      The method is called by the interrupt handler ConsoleGet.
 
@@ -232,7 +364,31 @@ void DriverConsole::GetAChar(){
 
   IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
 
-  get->V();
+  char c = g_machine->console->GetChar();
+
+  if (in_count == CONSOLE_IN_SIZE)
+
+    in_lost++;
+
+  else {
+
+    in_buffer[(in_head + in_count) % CONSOLE_IN_SIZE] = c;
+
+    in_count++;
+
+    if (c == '\n')
+
+      in_lines++;
+
+  }
+
+  if ((in_wanted > 0) && InputReady()) {
+
+    in_wanted = 0;
+
+    get->V();
+
+  }
 
   (void) g_machine->interrupt->SetStatus(oldLevel);
 
@@ -242,6 +398,36 @@ void DriverConsole::GetAChar(){
 
 
 
+//-----------------------------------------------------------------
+
+// DriverConsole::InputReady
+
+/*!     Check whether the reader can be served: in canonical mode, a
+
+//      complete line is buffered (or the buffer is full, or holds the
+
+//      requested count); in raw mode, the requested count is buffered.
+
+//      Interrupts must be disabled.
+
+*/
+
+//-----------------------------------------------------------------
+
+bool DriverConsole::InputReady(){
+
+  int wanted = (in_wanted < CONSOLE_IN_SIZE) ? in_wanted : CONSOLE_IN_SIZE;
+
+  if (canonical && (in_lines > 0))
+
+    return true;
+
+  return (in_count >= wanted);
+
+}
+
+
+
 
 
 //-----------------------------------------------------------------
@@ -250,57 +436,233 @@ void DriverConsole::GetAChar(){
 
 /*!     Receive a string from the console device using a lock to 
 
-//      prevent from concurrent accesses. The method returns when
+//      prevent from concurrent accesses. In canonical mode, the
+
+//      method returns at the end of a line (the '\n' is included)
 
-//      all characters has been received.
+//      or when nbcar chars are read; in raw mode, it returns when
+
+//      nbcar chars are read. The string is terminated by a '\0' if
+
+//      there is room for it.
 
 //
 
 //      \param buffer is the structure to fill
 
-/       \param size is the number max of char to be received
+//      \param nbcar is the number max of char to be received
+
+//      \return the number of chars received
 
 */
 
 //-----------------------------------------------------------------
 
-void DriverConsole::GetString(char *buffer,int nbcar) {
+int DriverConsole::GetString(char *buffer,int nbcar) {
 
   
 
   char c = 0;
 
-  int i;
+  int i = 0;
 
 
 
   mutexget->Acquire();
 
-  g_machine->console->EnableInterrupt();
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (!in_enabled) {
+
+    in_enabled = true;
+
+    g_machine->console->EnableInterrupt();
+
+  }
 
   
 
-  for (i=0;((i<nbcar) && (c!='\n'));i++) {
+  while ((i < nbcar) && (c != '\n')) {
+
+    // Wait once for the whole request (or what fits in the buffer)
+
+    in_wanted = nbcar - i;
+
+    if (!InputReady())
+
+      get->P();
+
+    in_wanted = 0;
+
+
+
+    // Copy the buffered chars
 
-    g_current_thread->GetProcessOwner()->stat->incrNumCharRead();
+    while ((i < nbcar) && (c != '\n') && (in_count > 0)) {
 
-    get->P();
+      g_current_thread->GetProcessOwner()->stat->incrNumCharRead();
 
-    c =  g_machine->console->GetChar();
+      c = in_buffer[in_head];
 
-    buffer[i] = c;
+      in_head = (in_head + 1) % CONSOLE_IN_SIZE;
+
+      in_count--;
+
+      if (c == '\n')
+
+	in_lines--;
+
+      buffer[i++] = c;
+
+    }
+
+    if (!canonical)
+
+      c = 0;
 
   }
 
-  buffer[i] = 0;
+  if (i < nbcar)
 
+    buffer[i] = 0;
 
 
-  g_machine->console->DisableInterrupt();
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
 
   mutexget->Release();
 
+  return i;
+
+}
+
+
+
+//-----------------------------------------------------------------
+
+// DriverConsole::SetCanonical
+
+/*!     Choose the input mode: canonical (line) mode, or raw mode.
+
+//
+
+//      \param canonical true for the canonical mode
+
+//      \return the previous mode
+
+*/
+
+//-----------------------------------------------------------------
+
+bool DriverConsole::SetCanonical(bool canonical) {
+
+  bool previous = this->canonical;
+
+  this->canonical = canonical;
+
+  return previous;
+
+}
+
+
+
+//-----------------------------------------------------------------
+
+// DriverConsole::DisableInput
+
+/*!     Stop reading the console device, until the next GetString.
+
+//      Used when no thread is left, since the pending read
+
+//      interrupts would otherwise keep Nachos running for ever.
+
+*/
+
+//-----------------------------------------------------------------
+
+void DriverConsole::DisableInput() {
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (in_enabled) {
+
+    in_enabled = false;
+
+    g_machine->console->DisableInterrupt();
+
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+
+}
+
+
+
+//-----------------------------------------------------------------
+
+// DriverConsole::SystemIdle
+
+/*!     Called by Thread::Sleep when no thread is ready (idle true)
+
+//      and once one is again (idle false). While the CPU is idle and
+
+//      no reader waits in GetString, a char typed could wake up
+
+//      nobody: the console is not polled meanwhile, so that its
+
+//      interrupts are not pending work, and Nachos halts when the
+
+//      threads left are all blocked for ever. The input is enabled
+
+//      again as soon as a thread can run.
+
+//
+
+//      \param idle true when the CPU becomes idle
+
+*/
+
+//-----------------------------------------------------------------
+
+void DriverConsole::SystemIdle(bool idle) {
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (idle && in_enabled && (in_wanted == 0)) {
+
+    in_enabled = false;
+
+    g_machine->console->DisableInterrupt();
+
+  } else if (!idle && !in_enabled) {
+
+    in_enabled = true;
+
+    g_machine->console->EnableInterrupt();
+
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+
+}
+
+
+
+//-----------------------------------------------------------------
+
+// DriverConsole::Print
+
+/*!     Print the console statistics: the chars dropped because the
+
+//      input buffer was full.
+
+*/
+
+//-----------------------------------------------------------------
+
+void DriverConsole::Print() {
 
+  printf("Console: %d input chars lost (buffer full)\n", in_lost);
 
 }
 
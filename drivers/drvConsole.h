@@ -36,6 +36,16 @@ class DriverConsole;
 
 
 
+//! Size of the console output ring buffer
+
+#define CONSOLE_OUT_SIZE 256
+
+
+
+//! Size of the console input ring buffer
+
+#define CONSOLE_IN_SIZE 256
+
 
 
 /*! \brief Defines a "synchronous" console abstraction.
@@ -50,9 +60,17 @@ class DriverConsole;
 
 // writes a string to the console and the second one reads a string from
 
-// the console. They return only when the read or write operation is 
+// the console. The read operation returns only when it is completed:
+
+// characters are read at all times into an input ring buffer, and a
+
+// reader is woken up once per line (canonical mode) or once its byte
+
+// count is available (raw mode). The write operation copies the string
+
+// into an output ring buffer, drained by the write interrupt handler,
 
-// completed.
+// and returns once the string is queued.
 
 */
 
@@ -68,16 +86,30 @@ class DriverConsole {
 
                              // Write a buffer on the console
 
-  void GetString(char *buffer,int nbcar);
+  int GetString(char *buffer,int nbcar);
 
                              // Read characters from the console
 
+  bool SetCanonical(bool canonical);
+
+                             // Choose line or raw input mode
+
+  void DisableInput();       // Stop reading the console device
+
+  void SystemIdle(bool idle); // Stop reading the console while no
+
+                             // thread can run and no reader waits
+
+  void Print();              // Print the console statistics
+
 
 
   void GetAChar();           // Send a char to the console device
 
   void PutAChar();           // Receive e char from the console
 
+  void Flush();              // Wait until the output buffer is empty
+
 
 
 private:
@@ -88,6 +120,42 @@ private:
 
   Semaphore *get, *put;      //!< Semaphores to wait for interrupts
 
+
+
+  char out_buffer[CONSOLE_OUT_SIZE];
+
+                             //!< Output ring buffer
+
+  int out_head;              //!< Next char to send (or being sent)
+
+  int out_count;             //!< Number of chars in the output buffer
+
+  bool out_busy;             //!< A char is being sent by the device
+
+  bool out_waiting;          //!< A writer waits for free space
+
+
+
+  char in_buffer[CONSOLE_IN_SIZE];
+
+                             //!< Input ring buffer
+
+  int in_head;               //!< Next char to read
+
+  int in_count;              //!< Number of chars in the input buffer
+
+  int in_lines;              //!< Number of complete lines in the buffer
+
+  int in_wanted;             //!< Chars awaited by the reader, 0 if none
+
+  int in_lost;               //!< Chars dropped because of a full buffer
+
+  bool in_enabled;           //!< The console read interrupts are enabled
+
+  bool canonical;            //!< Line mode if true, raw mode otherwise
+
+  bool InputReady();         //!< The reader can be woken up
+
 };
 
     
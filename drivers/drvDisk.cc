@@ -16,13 +16,21 @@
 
 //
 
-//	Use a semaphore to synchronize the interrupt handlers with the
+//	Because the physical disk can only handle one operation at a
 
-//	pending requests.  And, because the physical disk can only
+//	time, the requests are kept in a queue and started one after
 
-//	handle one operation at a time, use a lock to enforce mutual
+//	the other from the interrupt handler. The order in which they
 
-//	exclusion.
+//	are served is chosen by an elevator (C-LOOK), possibly
+
+//	overridden by per-request deadlines, and requests to adjacent
+
+//	sectors are merged into chains transferred back to back.
+
+//	Each request has a semaphore to synchronize the requesting
+
+//	thread with the interrupt handler.
 
 */
 
@@ -34,8 +42,38 @@
 
 
 
+#include <string.h>
+
+#include "kernel/system.h"
+
+#include "utility/config.h"
+
+#include "utility/stats.h"
+
+#include "kernel/thread.h"
+
 #include "drivers/drvDisk.h"
 
+#include "drivers/bufcache.h"
+
+#include "userlib/syscall.h"
+
+
+
+// The I/O priority classes of userlib/syscall.h are the classes of the
+
+// disk queues (SC_IO_PRIORITY stores them as is): fail to compile if
+
+// they drift apart
+
+typedef char check_io_prio_interactive
+
+  [(IO_PRIO_INTERACTIVE == DISK_PRIO_INTERACTIVE) ? 1 : -1];
+
+typedef char check_io_prio_background
+
+  [(IO_PRIO_BACKGROUND == DISK_PRIO_BACKGROUND) ? 1 : -1];
+
 
 
 //----------------------------------------------------------------------
@@ -96,22 +134,52 @@ void DiskSwapRequestDone()
 
 //	initializing the physical disk.
 
+//
+
+//	\param name the name of the driver (debugging)
+
+//	\param theDisk the disk device
+
 */
 
 //----------------------------------------------------------------------
 
 
 
-DriverDisk::DriverDisk(char* sem_name, char *lock_name, Disk* theDisk)
+DriverDisk::DriverDisk(char* name, Disk* theDisk)
 
 {
 
-    semaphore = new Semaphore((char*)sem_name, 0);
-
-    lock = new Lock((char*)lock_name);
+    this->name = name;
 
     disk = theDisk;
 
+    policy = (g_cfg->DiskScheduler == DISK_SCHED_DEADLINE) ?
+
+      DISK_SCHED_DEADLINE : DISK_SCHED_CLOOK;
+
+    cache = NULL;
+
+    current = NULL;
+
+    next_position = 0;
+
+    memset(passed_over, 0, sizeof(passed_over));
+
+    memset(&total, 0, sizeof(total));
+
+    memset(by_origin, 0, sizeof(by_origin));
+
+    depth = max_depth = 0;
+
+    sum_depth = 0;
+
+    nb_submitted = 0;
+
+    drained = new Semaphore((char*)"disk drained", 0);
+
+    nb_drain_waiters = 0;
+
 }
 
 
@@ -122,7 +190,11 @@ DriverDisk::DriverDisk(char* sem_name, char *lock_name, Disk* theDisk)
 
 /*! 	Destructor.
 
-//      De-allocate data structures needed for the disk driver.
+//      De-allocate data structures needed for the disk driver. No
+
+//      thread is left to wait for the pending requests: Cleanup drains
+
+//      the queue before, so that no write-behind is lost.
 
 */
 
@@ -134,9 +206,7 @@ DriverDisk::~DriverDisk()
 
 {
 
-    delete lock;
-
-    delete semaphore;
+    delete drained;
 
 }
 
@@ -148,7 +218,7 @@ DriverDisk::~DriverDisk()
 
 /*! 	Read the contents of a disk sector into a buffer. Return only
 
-//	after the data has been read.
+//	after the data has been read, from the buffer cache if any.
 
 //
 
@@ -170,17 +240,17 @@ DriverDisk::ReadSector(int sectorNumber, char* data)
 
     DEBUG('d', (char*)"[sdisk] rd req\n");
 
-    lock->Acquire();			// only one disk I/O at a time
+    if (cache != NULL) {
 
-    disk->ReadRequest(sectorNumber, data);
+      cache->Read(this, sectorNumber, data);
 
-    DEBUG('d', (char*)"[sdisk] rd req: wait irq\n");
+      return;
 
-    semaphore->P();			// wait for interrupt
+    }
 
-    DEBUG('d', (char*)"[sdisk] rd req: wait irq OK\n");
+    Wait(Submit(sectorNumber, data, false));
 
-    lock->Release();
+    DEBUG('d', (char*)"[sdisk] rd req: wait irq OK\n");
 
 }
 
@@ -192,7 +262,9 @@ DriverDisk::ReadSector(int sectorNumber, char* data)
 
 /*! 	Write the contents of a buffer into a disk sector.  Return only
 
-//	after the data has been written.
+//	after the data has been written, or copied to the buffer cache if
+
+//	any (it is written back later).
 
 //
 
@@ -214,17 +286,53 @@ DriverDisk::WriteSector(int sectorNumber, char* data)
 
     DEBUG('d', (char*)"[sdisk] wr req\n");
 
-    lock->Acquire();			// only one disk I/O at a time
+    if (cache != NULL) {
 
-    disk->WriteRequest(sectorNumber, data);
+      cache->Write(this, sectorNumber, data);
 
-    DEBUG('d', (char*)"[sdisk] wr req: wait irq...\n");
+      return;
 
-    semaphore->P();			// wait for interrupt
+    }
+
+    Wait(Submit(sectorNumber, data, true));
 
     DEBUG('d', (char*)"[sdisk] wr req: wait irq OK\n");
 
-    lock->Release();
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::ReadSectors
+
+/*! 	Read consecutive disk sectors into a list of buffers (scatter).
+
+//	Return only after all the data has been read.
+
+//
+
+//	\param sectorNumber the first disk sector to read
+
+//	\param data the buffers, one per sector
+
+//	\param nbSectors the number of sectors to read
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::ReadSectors(int sectorNumber, char** data, int nbSectors)
+
+{
+
+    DEBUG('d', (char*)"[sdisk] rd req %d sectors\n", nbSectors);
+
+    TransferSectors(sectorNumber, data, nbSectors, false);
 
 }
 
@@ -232,11 +340,21 @@ DriverDisk::WriteSector(int sectorNumber, char* data)
 
 //----------------------------------------------------------------------
 
-// DriverDisk::RequestDone
+// DriverDisk::WriteSectors
 
-/*! 	Disk interrupt handler. Wake up any thread waiting for the disk
+/*! 	Write a list of buffers into consecutive disk sectors (gather).
 
-//	request to finish.
+//	Return only after all the data has been written, or copied to
+
+//	the buffer cache if any.
+
+//
+
+//	\param sectorNumber the first disk sector to write
+
+//	\param data the buffers, one per sector
+
+//	\param nbSectors the number of sectors to write
 
 */
 
@@ -246,13 +364,1321 @@ DriverDisk::WriteSector(int sectorNumber, char* data)
 
 void
 
-DriverDisk::RequestDone()
+DriverDisk::WriteSectors(int sectorNumber, char** data, int nbSectors)
 
-{ 
+{
+
+    DEBUG('d', (char*)"[sdisk] wr req %d sectors\n", nbSectors);
+
+    TransferSectors(sectorNumber, data, nbSectors, true);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::TransferSectors
+
+/*! 	Transfer consecutive sectors as a single vectored request: the
+
+//	sectors are queued as one chain, transferred back to back (the
+
+//	device still interrupts once per sector), and the calling thread
+
+//	is woken up once, when the last one completes.
+
+//
+
+//	With a buffer cache, the sectors go through the cache, so that
+
+//	the cached copies stay coherent: the sectors found there are
+
+//	copied at once, and the others read as a single request.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::TransferSectors(int sectorNumber, char** data, int nbSectors,
+
+			    bool write)
+
+{
+
+    if (nbSectors <= 0)
+
+      return;
+
+    if (cache != NULL) {
+
+      // Writes only fill the cache, they never wait for the disk
+
+      if (write) {
+
+	for (int i = 0; i < nbSectors; i++)
+
+	  cache->Write(this, sectorNumber + i, data[i]);
+
+      }
+
+      else
+
+	cache->ReadSectors(this, sectorNumber, data, nbSectors);
+
+      return;
+
+    }
+
+    Wait(SubmitGroup(sectorNumber, data, nbSectors, write));
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Submit
+
+/*! 	Queue a request and return without waiting for its completion.
+
+//	The buffer must stay valid until the request is complete, which
+
+//	is known by calling Wait.
+
+//
+
+//	\param sectorNumber the disk sector to transfer
+
+//	\param data the buffer to transfer from/to
+
+//	\param write true for a write request, false for a read request
+
+//	\param origin the origin of the request (DiskOrigin), -1 for the
+
+//	origin of the current thread
+
+//	\return the request, to be given to Wait
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+DiskRequest *
+
+DriverDisk::Submit(int sectorNumber, char* data, bool write, int origin)
+
+{
+
+    DiskRequest *request = NewRequest(sectorNumber, data, write, origin);
+
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+    if (Admit(request)) {
+
+      Enqueue(request);
+
+      if (current == NULL)
+
+	StartTransfer(NULL);
+
+    }
+
+    g_machine->interrupt->SetStatus(old);
+
+    return request;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::SubmitGroup
+
+/*! 	Queue a vectored request on consecutive sectors and return
+
+//	without waiting for its completion. The requests of the sectors
+
+//	are linked into chains before they are queued, so that they are
+
+//	transferred back to back, and the group completes with the last
+
+//	one. The buffers must stay valid until the group is complete,
+
+//	which is known by calling Wait.
+
+//
+
+//	\param sectorNumber the first disk sector to transfer
+
+//	\param data the buffers, one per sector (NULL: sector skipped)
+
+//	\param nbSectors the number of sectors
+
+//	\param write true for a write request, false for a read request
+
+//	\return the group, to be given to Wait
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+DiskRequest *
+
+DriverDisk::SubmitGroup(int sectorNumber, char** data, int nbSectors,
+
+			bool write)
+
+{
+
+    // The group is only a completion point, it is never queued
+
+    DiskRequest *group = NewRequest(sectorNumber, NULL, write, -1);
+
+    group->nb_pending = 0;
+
+    for (int i = 0; i < nbSectors; i++)
+
+      if (data[i] != NULL)
+
+	group->nb_pending++;
+
+
+
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+    if (group->nb_pending == 0) {
+
+      group->done = true;
+
+      group->completion->V();
+
+      g_machine->interrupt->SetStatus(old);
+
+      return group;
+
+    }
+
+    DiskRequest *chain = NULL;
+
+    for (int i = 0; i < nbSectors; i++) {
+
+      if (data[i] == NULL)
+
+	continue;
+
+      DiskRequest *request = NewRequest(sectorNumber + i, data[i], write, -1);
+
+      request->group = group;
+
+      if (!Admit(request))
+
+	continue;
+
+      if (chain != NULL
+
+	  && (chain->sector + chain->nb_merged != request->sector
+
+	      || chain->nb_merged == DISK_MAX_MERGE)) {
+
+	Enqueue(chain);
+
+	chain = NULL;
+
+      }
+
+      if (chain == NULL)
+
+	chain = request;
+
+      else {
+
+	chain->merged_last->merged = request;
+
+	chain->merged_last = request;
+
+	chain->nb_merged++;
+
+      }
+
+    }
+
+    if (chain != NULL)
+
+      Enqueue(chain);
+
+    if (current == NULL)
+
+      StartTransfer(NULL);
+
+    g_machine->interrupt->SetStatus(old);
+
+    return group;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Admit
+
+/*! 	Account a new request, and tell whether it must be queued.
+
+//	A read of a sector which has a pending write is served at once
+
+//	from the data of the latest one, whether it is queued, held or
+
+//	being transferred. A write supersedes the pending write of the
+
+//	same sector, if it has not been started yet. A write of a sector
+
+//	which has queued reads is held until they complete, so that it
+
+//	cannot overtake them when it is in another chain or class.
+
+//	Interrupts must be disabled.
+
+//
+
+//	\param request the new request
+
+//	\return true if the request must be queued, false if it was
+
+//	served or held
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+bool
+
+DriverDisk::Admit(DiskRequest *request)
+
+{
+
+    int sectorNumber = request->sector;
+
+
+
+    depth++;
+
+    if (depth > max_depth) max_depth = depth;
+
+    sum_depth += depth;
+
+    nb_submitted++;
+
+
+
+    std::map<int,DiskRequest*>::iterator w = pending_writes.find(sectorNumber);
+
+    if (!request->write && w != pending_writes.end()) {
+
+      DEBUG('d', (char*)"[%s] rd %d served from pending write\n",
+
+	    name, sectorNumber);
+
+      memcpy(request->data, w->second->data, g_cfg->SectorSize);
+
+      Complete(request);
+
+      return false;
+
+    }
+
+    if (request->write) {
+
+      if (w != pending_writes.end() && w->second != current) {
+
+	DEBUG('d', (char*)"[%s] wr %d supersedes a pending write\n",
+
+	      name, sectorNumber);
+
+	w->second->skip = true;
+
+      }
+
+      pending_writes[sectorNumber] = request;
+
+      if (pending_reads.find(sectorNumber) != pending_reads.end()) {
+
+	DEBUG('d', (char*)"[%s] wr %d held behind a read\n",
+
+	      name, sectorNumber);
+
+	held_writes.insert(std::make_pair(sectorNumber, request));
+
+	return false;
+
+      }
+
+    }
+
+    else
+
+      pending_reads[sectorNumber]++;
+
+    return true;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Wait
+
+/*! 	Wait for the completion of a request returned by Submit, and
+
+//	free it.
+
+//
+
+//	\param request the request to wait for
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::Wait(DiskRequest *request)
+
+{
+
+    request->completion->P();
+
+    delete request->completion;
+
+    delete request;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::WriteBehind
+
+/*! 	Queue a write of a copy of a buffer, and return at once.  The
+
+//	request is freed by the driver once complete.
+
+//
+
+//	\param sectorNumber  the disk sector to be written
+
+//	\param data  the new contents of the disk sector
+
+//	\param origin  the origin of the request (DiskOrigin), -1 for the
+
+//	origin of the current thread
+
+//	\param stat  the statistics of the process the write is charged
+
+//	to, NULL to charge it as NewRequest does (a write-back of the
+
+//	buffer cache is charged to the process which wrote the sector)
+
+//	\param process  the name of that process
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::WriteBehind(int sectorNumber, char* data, int origin,
+
+			ProcessStat *stat, const char *process)
+
+{
+
+    char *copy = new char[g_cfg->SectorSize];
+
+    memcpy(copy, data, g_cfg->SectorSize);
+
+    DEBUG('d', (char*)"[%s] wr-behind req %d\n", name, sectorNumber);
+
+
+
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+    DiskRequest *request = Submit(sectorNumber, copy, true, origin);
+
+    // A write is never complete before it is transferred, so it is
+
+    // not accounted yet, and is freed by Complete
+
+    ASSERT(!request->done);
+
+    if (stat != NULL) {
+
+      request->stat = stat;
+
+      request->process = process;
+
+    }
+
+    request->detached = true;
+
+    g_machine->interrupt->SetStatus(old);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Drain
+
+/*! 	Wait until every submitted request is complete, including the
+
+//	writes behind. The calling thread sleeps until the completion
+
+//	handler empties the queue, so this must be called from a thread,
+
+//	before the shutdown deletes the current one.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::Drain()
+
+{
+
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+    if (depth > 0) {
+
+      nb_drain_waiters++;
+
+      drained->P();
+
+    }
+
+    g_machine->interrupt->SetStatus(old);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::SetCache
+
+/*! 	Serve ReadSector and WriteSector through a buffer cache. Submit
+
+//	and WriteBehind still go to the disk directly.
+
+//
+
+//	\param cache the buffer cache, NULL to disable caching
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::SetCache(BufferCache *cache)
+
+{
+
+    this->cache = cache;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Print
+
+/*! 	Print the I/O statistics of the disk: totals, queue depth, and
+
+//	breakdown per origin and per process. Times are in ticks.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+static void
+
+PrintCounters(const char *label, DiskIoCounters *c)
+
+{
+
+    int n = c->nb_reads + c->nb_writes;
+
+    printf("  %-12s %6d reads %6d writes %8lld bytes, "
+
+	   "wait %llu (avg %llu), service %llu (avg %llu)\n",
+
+	   label, c->nb_reads, c->nb_writes, (long long)c->nb_bytes,
+
+	   (unsigned long long)c->wait_ticks,
+
+	   (unsigned long long)(n ? c->wait_ticks / n : 0),
+
+	   (unsigned long long)c->service_ticks,
+
+	   (unsigned long long)(n ? c->service_ticks / n : 0));
+
+}
+
+
+
+void
+
+DriverDisk::Print()
+
+{
+
+    static const char *origins[NB_DISK_ORIGINS] =
+
+      {"file", "page fault", "swap out", "write-back"};
+
+
+
+    printf("Disk \"%s\": queue depth max %d, avg %.2f\n", name, max_depth,
+
+	   nb_submitted ? (double)sum_depth / nb_submitted : 0.0);
+
+    PrintCounters("total", &total);
+
+    for (int i = 0; i < NB_DISK_ORIGINS; i++)
+
+      if (by_origin[i].nb_reads + by_origin[i].nb_writes > 0)
+
+	PrintCounters(origins[i], &by_origin[i]);
+
+    for (unsigned int i = 0; i < by_process.size(); i++)
+
+      PrintCounters(process_names[i].c_str(), &by_process[i]);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::RequestDone
+
+/*! 	Disk interrupt handler. Wake up the thread waiting for the
+
+//	request to finish, and start the next transfer.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::RequestDone()
+
+{ 
+
+  DEBUG('d', (char*)"[%s] req done\n", name);
+
+  DiskRequest *request = current;
+
+  DiskRequest *next = request->merged;
+
+  current = NULL;
+
+  Complete(request);
+
+  StartTransfer(next);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::NewRequest
+
+/*! 	Allocate a request, charged to the current process. Its class is
+
+//	given by its origin: page fault reads are synchronous, swap-outs
+
+//	and write-backs are background, and the other requests take the
+
+//	I/O priority of the process.
+
+//
+
+//	\param origin the origin of the request (DiskOrigin), -1 for the
+
+//	origin of the current thread
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+DiskRequest *
+
+DriverDisk::NewRequest(int sectorNumber, char* data, bool write, int origin)
+
+{
+
+    DiskRequest *request = new DiskRequest;
+
+    request->sector = sectorNumber;
+
+    request->data = data;
+
+    request->write = write;
+
+    request->detached = false;
+
+    request->skip = false;
+
+    request->done = false;
+
+    request->completion = new Semaphore((char*)"disk request", 0);
+
+    request->submit_time = g_stats->getTotalTicks();
+
+    request->start_time = request->submit_time;
+
+    request->transferred = false;
+
+    request->deadline = request->submit_time
+
+      + (write ? DISK_WRITE_EXPIRE : DISK_READ_EXPIRE);
+
+    request->origin = DISK_ORIGIN_FILE;
+
+    request->prio = DISK_PRIO_INTERACTIVE;
+
+    request->stat = NULL;
+
+    request->process = "kernel";
+
+    Process *process = NULL;
+
+    if (g_current_thread != NULL) {
+
+      request->origin = g_current_thread->GetIoOrigin();
+
+      process = g_current_thread->GetProcessOwner();
+
+    }
+
+    if (origin >= 0)
+
+      request->origin = origin;
+
+    // Delayed writes are not charged to the thread that happens to run
+
+    if (process != NULL && request->origin != DISK_ORIGIN_WRITEBACK) {
+
+      request->stat = process->stat;
+
+      request->process = process->getName();
+
+      request->prio = process->io_priority;
+
+    }
+
+    if (request->origin == DISK_ORIGIN_PAGEFAULT && !write)
+
+      request->prio = DISK_PRIO_SYNC;
+
+    else if (request->origin == DISK_ORIGIN_SWAPOUT
+
+	     || request->origin == DISK_ORIGIN_WRITEBACK)
+
+      request->prio = DISK_PRIO_BACKGROUND;
+
+    request->group = NULL;
+
+    request->nb_pending = 1;
+
+    request->merged = NULL;
+
+    request->merged_last = request;
+
+    request->nb_merged = 1;
+
+    return request;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Enqueue
+
+/*! 	Insert a request, or a chain of requests on consecutive
+
+//	sectors, in the queue of its class. It is appended to a chain
+
+//	ending on the previous sector, or becomes the head of a chain
+
+//	starting on the next sector, if they go in the same direction.
+
+//	Interrupts must be disabled.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::Enqueue(DiskRequest *request)
+
+{
+
+    std::multimap<int,DiskRequest*> &queue = this->queue[request->prio];
+
+    std::multimap<int,DiskRequest*>::iterator it;
+
+
+
+    // Back merge: a chain ending right before the request
+
+    for (it = queue.lower_bound(request->sector - DISK_MAX_MERGE + 1);
+
+	 it != queue.end() && it->first < request->sector; it++) {
+
+      DiskRequest *head = it->second;
+
+      if (head->write == request->write
+
+	  && head->sector + head->nb_merged == request->sector
+
+	  && head->nb_merged + request->nb_merged <= DISK_MAX_MERGE) {
+
+	head->merged_last->merged = request;
+
+	head->merged_last = request->merged_last;
+
+	head->nb_merged += request->nb_merged;
+
+	DEBUG('d', (char*)"[%s] %d merged after %d\n",
+
+	      name, request->sector, head->sector);
+
+	return;
+
+      }
+
+    }
+
+
+
+    // Front merge: a chain starting right after the request
+
+    int next = request->sector + request->nb_merged;
+
+    for (it = queue.lower_bound(next);
+
+	 it != queue.end() && it->first == next; it++) {
+
+      DiskRequest *head = it->second;
+
+      if (head->write == request->write
+
+	  && request->nb_merged + head->nb_merged <= DISK_MAX_MERGE) {
+
+	Dequeue(head);
+
+	request->merged_last->merged = head;
+
+	request->merged_last = head->merged_last;
+
+	request->nb_merged += head->nb_merged;
+
+	if (head->deadline < request->deadline)
+
+	  request->deadline = head->deadline;
+
+	DEBUG('d', (char*)"[%s] %d merged before %d\n",
+
+	      name, request->sector, head->sector);
+
+	break;
+
+      }
+
+    }
+
+
+
+    request->queue_pos = queue.insert(std::make_pair(request->sector, request));
+
+    request->expiry_pos = expiry[request->prio].insert(
+
+      std::make_pair(request->deadline, request));
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Dequeue
+
+/*! 	Remove the head of a chain from the queue.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::Dequeue(DiskRequest *request)
+
+{
+
+    queue[request->prio].erase(request->queue_pos);
+
+    expiry[request->prio].erase(request->expiry_pos);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::PickNext
+
+/*! 	Choose the next chain to serve and remove it from the queue.
+
+//	The highest non-empty class is served, unless a lower class has
+
+//	been passed over DISK_PRIO_STARVE_LIMIT times.
+
+//	Within the class, C-LOOK serves the first chain at or after the
+
+//	current position of the head, and wraps around to the lowest
+
+//	sector. The deadline policy serves the oldest expired chain
+
+//	first.
+
+//
+
+//	\return the chain to serve, NULL if the queue is empty
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+DiskRequest *
+
+DriverDisk::PickNext()
+
+{
+
+    DiskRequest *request;
+
+    int prio = -1;
+
+
+
+    for (int p = 0; p < NB_DISK_PRIOS; p++) {
+
+      if (queue[p].empty())
+
+	continue;
+
+      if (prio < 0)
+
+	prio = p;
+
+      else if (passed_over[p] >= DISK_PRIO_STARVE_LIMIT) {
+
+	DEBUG('d', (char*)"[%s] class %d starving\n", name, p);
+
+	prio = p;
+
+	break;
+
+      }
+
+    }
+
+    if (prio < 0)
+
+      return NULL;
+
+    for (int p = prio + 1; p < NB_DISK_PRIOS; p++)
+
+      if (!queue[p].empty())
+
+	passed_over[p]++;
+
+    passed_over[prio] = 0;
+
+
+
+    std::multimap<int,DiskRequest*> &queue = this->queue[prio];
+
+    std::multimap<Time,DiskRequest*> &expiry = this->expiry[prio];
+
+    if (policy == DISK_SCHED_DEADLINE
+
+	&& expiry.begin()->first <= g_stats->getTotalTicks()) {
+
+      request = expiry.begin()->second;
+
+      DEBUG('d', (char*)"[%s] %d expired\n", name, request->sector);
+
+    }
+
+    else {
+
+      std::multimap<int,DiskRequest*>::iterator it
+
+	= queue.lower_bound(next_position);
+
+      if (it == queue.end())
+
+	it = queue.begin();
+
+      request = it->second;
+
+    }
+
+    Dequeue(request);
+
+    return request;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::StartTransfer
+
+/*! 	Start the transfer of the next request: the given request of
+
+//	the current chain, or else the next chain of the queue.
+
+//	Superseded requests are completed without any transfer.
+
+//	Interrupts must be disabled.
+
+//
+
+//	\param request the next request of the current chain, or NULL
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::StartTransfer(DiskRequest *request)
+
+{
+
+    for (;;) {
+
+      while (request != NULL && request->skip) {
+
+	DiskRequest *next = request->merged;
+
+	Complete(request);
+
+	request = next;
+
+      }
+
+      if (request != NULL)
+
+	break;
+
+      request = PickNext();
+
+      if (request == NULL)
+
+	return;
+
+    }
+
+
+
+    current = request;
+
+    request->start_time = g_stats->getTotalTicks();
+
+    request->transferred = true;
+
+    next_position = request->sector + 1;
+
+    if (request->write)
+
+      disk->WriteRequest(request->sector, request->data);
+
+    else
+
+      disk->ReadRequest(request->sector, request->data);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Complete
+
+/*! 	Signal the completion of a request to the waiting thread, or
+
+//	free it if nobody waits for it. The members of a vectored
+
+//	request are freed, and the waiting thread is signaled when the
+
+//	last one completes. The writes held behind the last queued read
+
+//	of a sector are queued, and the threads in Drain are woken up
+
+//	once no request is left.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::Complete(DiskRequest *request)
+
+{
+
+    int sector = request->sector;
+
+    if (request->write) {
+
+      std::map<int,DiskRequest*>::iterator w = pending_writes.find(sector);
+
+      if (w != pending_writes.end() && w->second == request)
+
+	pending_writes.erase(w);
+
+    }
+
+    // Only the reads which went through the queue are counted, those
+
+    // served from a pending write are never transferred
+
+    else if (request->transferred && --pending_reads[sector] == 0) {
+
+      pending_reads.erase(sector);
+
+      std::multimap<int,DiskRequest*>::iterator h;
+
+      for (h = held_writes.lower_bound(sector);
+
+	   h != held_writes.end() && h->first == sector; )
+
+	Enqueue((h++)->second);
+
+      held_writes.erase(sector);
+
+    }
+
+    request->done = true;
+
+    Account(request);
+
+    if (request->group != NULL) {
+
+      DiskRequest *group = request->group;
+
+      delete request->completion;
+
+      delete request;
+
+      if (--group->nb_pending == 0) {
+
+	group->done = true;
+
+	group->completion->V();
+
+      }
+
+    }
+
+    else if (request->detached) {
+
+      delete [] request->data;
+
+      delete request->completion;
+
+      delete request;
+
+    }
+
+    else
+
+      request->completion->V();
+
+
+
+    if (depth == 0) {
+
+      while (nb_drain_waiters > 0) {
+
+	nb_drain_waiters--;
+
+	drained->V();
+
+      }
+
+    }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::Account
+
+/*! 	Update the statistics of the disk, of the origin and of the
+
+//	issuing process with a completed request. Superseded writes and
+
+//	reads served from a pending write count no transfer.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+void
+
+DriverDisk::Account(DiskRequest *request)
+
+{
+
+    Time now = g_stats->getTotalTicks();
+
+    DiskIoCounters *counters[3] = {&total, &by_origin[request->origin],
+
+				   ProcessCounters(request)};
+
+    if (!request->transferred)
+
+      request->start_time = now;
+
+
+
+    depth--;
+
+    for (int i = 0; i < 3; i++) {
+
+      if (request->write) counters[i]->nb_writes++;
+
+      else counters[i]->nb_reads++;
+
+      if (request->transferred) counters[i]->nb_bytes += g_cfg->SectorSize;
+
+      counters[i]->wait_ticks += request->start_time - request->submit_time;
+
+      counters[i]->service_ticks += now - request->start_time;
+
+    }
+
+    if (request->stat != NULL) {
+
+      if (request->write) request->stat->incrNumDiskWrites();
+
+      else request->stat->incrNumDiskReads();
+
+    }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// DriverDisk::ProcessCounters
+
+/*! 	Return the I/O statistics of the process of a request. The
+
+//	processes are told apart by their statistics object, so that two
+
+//	processes running the same program are not merged.
+
+*/
+
+//----------------------------------------------------------------------
+
+
+
+DiskIoCounters *
+
+DriverDisk::ProcessCounters(DiskRequest *request)
+
+{
+
+    std::map<ProcessStat*,int>::iterator it
+
+      = process_index.find(request->stat);
+
+    if (it != process_index.end())
+
+      return &by_process[it->second];
+
+    DiskIoCounters c;
+
+    memset(&c, 0, sizeof(c));
+
+    process_index[request->stat] = (int)by_process.size();
+
+    by_process.push_back(c);
 
-  DEBUG('d', (char*)"[sdisk] req done\n");
+    process_names.push_back(request->process);
 
-  semaphore->V();
+    return &by_process.back();
 
 }
 
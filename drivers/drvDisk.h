@@ -26,6 +26,12 @@
 
 
 
+#include <map>
+
+#include <string>
+
+#include <vector>
+
 #include "machine/disk.h"
 
 #include "kernel/synch.h"
@@ -34,7 +40,177 @@
 
 class Semaphore;
 
-class Lock;
+class BufferCache;
+
+class ProcessStat;
+
+
+
+/*! Scheduling policies of the disk request queue */
+
+enum DiskSchedPolicy {
+
+  DISK_SCHED_CLOOK = 0,    //!< Circular LOOK elevator
+
+  DISK_SCHED_DEADLINE      //!< C-LOOK, unless a request has expired
+
+};
+
+
+
+/*! Origin of a disk request, for the statistics */
+
+enum DiskOrigin {
+
+  DISK_ORIGIN_FILE = 0,    //!< File system access (default)
+
+  DISK_ORIGIN_PAGEFAULT,   //!< Page fault (executable or swap)
+
+  DISK_ORIGIN_SWAPOUT,     //!< Page evicted to the swap
+
+  DISK_ORIGIN_WRITEBACK,   //!< Write-back of the buffer cache
+
+  NB_DISK_ORIGINS
+
+};
+
+
+
+/*! I/O priority classes of the disk requests, from the highest (the
+
+    classes a process can choose are IO_PRIO_* in userlib/syscall.h) */
+
+enum DiskPriority {
+
+  DISK_PRIO_SYNC = 0,      //!< Synchronous page fault reads
+
+  DISK_PRIO_INTERACTIVE,   //!< File accesses (default of processes)
+
+  DISK_PRIO_BACKGROUND,    //!< Swap-out, write-back, batch processes
+
+  NB_DISK_PRIOS
+
+};
+
+
+
+//! Number of times a non-empty class may be passed over by higher
+
+//! classes before one of its requests is served
+
+#define DISK_PRIO_STARVE_LIMIT 8
+
+
+
+/*! \brief Disk I/O counters, per disk, origin or process */
+
+typedef struct {
+
+  int nb_reads;               //!< Number of sectors read
+
+  int nb_writes;              //!< Number of sectors written
+
+  int64_t nb_bytes;           //!< Number of bytes transferred
+
+  Time wait_ticks;            //!< Time spent in the queue
+
+  Time service_ticks;         //!< Time spent in transfer
+
+} DiskIoCounters;
+
+
+
+//! Ticks after which a queued read is served first by the deadline
+
+//! scheduler
+
+#define DISK_READ_EXPIRE  2000
+
+
+
+//! Ticks after which a queued write is served first by the deadline
+
+//! scheduler
+
+#define DISK_WRITE_EXPIRE 20000
+
+
+
+//! Maximum number of sectors chained by merging adjacent requests
+
+#define DISK_MAX_MERGE    32
+
+
+
+/*! \brief Defines a request in the queue of a disk driver
+
+//
+
+// Requests to adjacent sectors in the same direction are merged into
+
+// a chain: only the head of the chain is in the queue, and the
+
+// whole chain is transferred before the scheduler is run again.
+
+*/
+
+class DiskRequest {
+
+public:
+
+  int sector;                 //!< Sector to transfer
+
+  char *data;                 //!< Buffer to transfer from/to
+
+  bool write;                 //!< Write request if true, read otherwise
+
+  bool detached;              //!< Nobody waits: freed by the driver
+
+  bool skip;                  //!< Transfer not needed anymore
+
+  bool done;                  //!< The request is complete
+
+  Semaphore *completion;      //!< V'ed when the request completes
+
+  Time deadline;              //!< Expiry tick (deadline scheduler)
+
+  Time submit_time;           //!< Tick of the submission
+
+  Time start_time;            //!< Tick of the start of the transfer
+
+  bool transferred;           //!< The transfer was started
+
+  int origin;                 //!< Origin of the request (DiskOrigin)
+
+  int prio;                   //!< I/O priority class (DiskPriority)
+
+  ProcessStat *stat;          //!< Statistics of the issuing process
+
+  std::string process;        //!< Name of the issuing process
+
+  DiskRequest *group;         //!< Vectored request this one belongs to
+
+  int nb_pending;             //!< Requests of the vector not complete yet
+
+
+
+  DiskRequest *merged;        //!< Next request of the chain
+
+  DiskRequest *merged_last;   //!< Last request of the chain (head only)
+
+  int nb_merged;              //!< Number of requests of the chain (head only)
+
+
+
+  //! Position in the queue of the driver (head only)
+
+  std::multimap<int,DiskRequest*>::iterator queue_pos;
+
+  //! Position in the expiry queue of the driver (head only)
+
+  std::multimap<Time,DiskRequest*>::iterator expiry_pos;
+
+};
 
 
 
@@ -56,11 +232,17 @@ class Lock;
 
 //
 
-// This class provides the abstraction that for any individual thread
+// This class keeps a queue of pending requests in front of the
+
+// device. Requests are submitted without blocking, and are served
 
-// making a request, it waits around until the operation finishes before
+// in the order chosen by the scheduling policy (C-LOOK or deadline)
 
-// returning.
+// as the device completes the previous ones. Requests are sorted
+
+// in priority classes, higher classes being served first. ReadSector and
+
+// WriteSector submit a request and wait until it is complete.
 
 */
 
@@ -68,13 +250,15 @@ class DriverDisk {
 
   public:
 
-  DriverDisk(char* sem_name, char* lock_name, Disk* theDisk); 
+  DriverDisk(char* name, Disk* theDisk); 
 
                                         // Constructor. Initializes the disk
 
                                         // driver by initializing the raw Disk.
 
-    ~DriverDisk();			// Destructor. De-allocate the driver data
+    ~DriverDisk();			// Destructor. De-allocate the driver,
+
+					// the queue must have been drained
 
     
 
@@ -88,8 +272,54 @@ class DriverDisk {
 
     void WriteSector(int sectorNumber, char* data);
 
+    void ReadSectors(int sectorNumber, char** data, int nbSectors);
+
+    					// Read/write consecutive sectors from/to
+
+					// a list of buffers, as a single request
+
+    void WriteSectors(int sectorNumber, char** data, int nbSectors);
+
+
+
+    DiskRequest *Submit(int sectorNumber, char* data, bool write,
+
+			int origin = -1);
+
+					// Queue a request and return at once
+
+    DiskRequest *SubmitGroup(int sectorNumber, char** data, int nbSectors,
+
+			     bool write);
+
+					// Queue a request on consecutive
+
+					// sectors and return at once
+
+    void Wait(DiskRequest *request);	// Wait for the completion of a
+
+					// submitted request, and free it
+
+    void WriteBehind(int sectorNumber, char* data, int origin = -1,
+
+		     ProcessStat *stat = NULL, const char *process = NULL);
+
+					// Queue a write of a copy of data,
+
+					// nobody waits for its completion
+
+    void Drain();			// Wait until the queue is empty
+
+    void SetCache(BufferCache *cache);	// Serve ReadSector and WriteSector
+
+					// through a buffer cache
+
     
 
+    void Print();			// Print the I/O statistics
+
+
+
     void RequestDone();			// Called by the disk device interrupt
 
 					// handler, to signal that the
@@ -100,18 +330,142 @@ class DriverDisk {
 
 private:
 
-  Semaphore *semaphore; 		/*!< To synchronize requesting thread 
+  DiskRequest *NewRequest(int sectorNumber, char* data, bool write,
+
+			  int origin);
+
+  void TransferSectors(int sectorNumber, char** data, int nbSectors,
+
+		       bool write);	/*!< Common part of ReadSectors and
+
+					     WriteSectors */
+
+  bool Admit(DiskRequest *request);	/*!< Account a new request, and
+
+					     tell whether it must be
+
+					     queued */
+
+  void Enqueue(DiskRequest *request);	/*!< Insert or merge a request in
+
+					     the queue */
+
+  void Dequeue(DiskRequest *request);	/*!< Remove a chain head from the
+
+					     queue */
+
+  DiskRequest *PickNext();		/*!< Choose the next chain to serve */
+
+  void StartTransfer(DiskRequest *request);
+
+					/*!< Start the next transfer, from
+
+					     request or from the queue */
 
-					     with the interrupt handler
+  void Complete(DiskRequest *request);	/*!< Signal the completion of a
 
-					*/
+					     request */
 
-  Lock *lock;		  		/*!< Mutual exclusion on the disk device
+  void Account(DiskRequest *request);	/*!< Update the statistics with a
 
-					*/
+					     completed request */
+
+  DiskIoCounters *ProcessCounters(DiskRequest *request);
+
+					/*!< Statistics of the process of a
+
+					     request */
+
+
+
+  char *name;				/*!< Name of the driver */
+
+  BufferCache *cache;			/*!< Buffer cache, NULL if none */
 
   Disk *disk;                         /* The disk */
 
+  DiskSchedPolicy policy;		/*!< Scheduling policy */
+
+  std::multimap<int,DiskRequest*> queue[NB_DISK_PRIOS];
+
+					/*!< Pending chains of each class,
+
+					     by sector */
+
+  std::multimap<Time,DiskRequest*> expiry[NB_DISK_PRIOS];
+
+					/*!< Pending chains of each class,
+
+					     by deadline */
+
+  int passed_over[NB_DISK_PRIOS];	/*!< Times each class was passed
+
+					     over by a higher class */
+
+  std::map<int,DiskRequest*> pending_writes;
+
+					/*!< Latest pending write of each
+
+					     sector, used to serve reads and
+
+					     to drop superseded writes */
+
+  std::map<int,int> pending_reads;	/*!< Number of queued reads of each
+
+					     sector */
+
+  std::multimap<int,DiskRequest*> held_writes;
+
+					/*!< Writes held until the queued
+
+					     reads of their sector complete */
+
+  DiskRequest *current;			/*!< Request being transferred */
+
+  int next_position;			/*!< Sector following the last one
+
+					     transferred (C-LOOK) */
+
+
+
+  DiskIoCounters total;			/*!< I/O statistics of the disk */
+
+  DiskIoCounters by_origin[NB_DISK_ORIGINS];
+
+					/*!< I/O statistics per origin */
+
+  std::vector<DiskIoCounters> by_process;
+
+					/*!< I/O statistics per process */
+
+  std::vector<std::string> process_names;
+
+					/*!< Name of each process of
+
+					     by_process */
+
+  std::map<ProcessStat*,int> process_index;
+
+					/*!< Index in by_process of each
+
+					     process, by its statistics
+
+					     object (NULL for the kernel) */
+
+  int depth;				/*!< Number of requests not complete */
+
+  int max_depth;			/*!< Maximum of depth */
+
+  int64_t sum_depth;			/*!< Sum of depth seen by the
+
+					     submitted requests */
+
+  int nb_submitted;			/*!< Number of submitted requests */
+
+  Semaphore *drained;			/*!< V'ed when the queue empties */
+
+  int nb_drain_waiters;			/*!< Threads waiting in Drain */
+
 };
 
 
@@ -0,0 +1,547 @@
+/*! \file transport.cc
+//  \brief Routines of the reliable transport over the ACIA
+//
+//	Segments are sent and received as ACIA messages. The data
+//	segments of a connection are numbered; the receiver only
+//	accepts the segment it expects next and acknowledges, for each
+//	data segment received, the next sequence number it expects
+//	(cumulative ACK). The sender keeps up to a window of segments
+//	not acknowledged yet; when the oldest one is not acknowledged
+//	within the retransmission timeout, the whole window is sent
+//	again (go-back-N) and the timeout is doubled.
+//
+//	The timeout is computed from the round-trip times measured on
+//	the segments sent once (Jacobson's algorithm, with Karn's rule).
+//
+//  Copyright (c) 1999-2000 INSA de Rennes.
+//  All rights reserved.
+//  See copyright_insa.h for copyright notice and limitation
+//  of liability and disclaimer of warranty provisions.
+*/
+
+#include "kernel/system.h"
+#include "kernel/synch.h"
+#include "machine/interrupt.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+#include "drivers/drvACIA.h"
+#include "drivers/transport.h"
+
+//! Sequence numbers are 16-bit, and wrap around
+#define SEQ(x) ((x) & 0xffff)
+
+//----------------------------------------------------------------------
+// TransportSegmentReceived
+/*! 	Receive handler set in the ACIA driver. Need this to be a C
+//	routine, because C++ can't handle pointers to member functions.
+*/
+//----------------------------------------------------------------------
+
+void TransportSegmentReceived(char *msg, int len)
+{
+  g_transport->SegmentReceived(msg, len);
+}
+
+//----------------------------------------------------------------------
+// TransportTimer
+/*! 	Timer handler of the retransmissions.
+*/
+//----------------------------------------------------------------------
+
+void TransportTimer(int64_t arg)
+{
+  ((Transport *)arg)->TimerHandler();
+}
+
+//----------------------------------------------------------------------
+// Transport::Transport
+/*! 	Constructor. Initialize the connections, all closed. The window
+//	is read from the configuration (TransportWindow).
+*/
+//----------------------------------------------------------------------
+
+Transport::Transport()
+{
+  window = g_cfg->TransportWindow;
+  if (window <= 0)
+    window = TRANSPORT_DEFAULT_WINDOW;
+  if (window > TRANSPORT_MAX_WINDOW)
+    window = TRANSPORT_MAX_WINDOW;
+  for (int i = 0; i < TRANSPORT_NB_PORTS; i++) {
+    conn[i].open = false;
+    conn[i].send_lock = new Lock((char*)"transport send");
+    conn[i].receive_lock = new Lock((char*)"transport receive");
+    conn[i].window_sema = new Semaphore((char*)"transport window", 0);
+    conn[i].receive_sema = new Semaphore((char*)"transport receive", 0);
+    conn[i].window_waiting = false;
+    conn[i].receive_waiting = false;
+  }
+  timer_armed = false;
+  handler_set = false;
+  nb_segments_sent = nb_retransmits = nb_timeouts = nb_acks_sent = 0;
+  nb_segments_received = nb_duplicates = nb_no_room = nb_bad_checksum = 0;
+  nb_bytes_sent = nb_bytes_received = 0;
+}
+
+//----------------------------------------------------------------------
+// Transport::~Transport
+/*! 	Destructor. Stop receiving the segments and free the
+//	connections.
+*/
+//----------------------------------------------------------------------
+
+Transport::~Transport()
+{
+  if (handler_set)
+    g_acia_driver->SetReceiveHandler(NULL);
+  for (int i = 0; i < TRANSPORT_NB_PORTS; i++) {
+    delete conn[i].send_lock;
+    delete conn[i].receive_lock;
+    delete conn[i].window_sema;
+    delete conn[i].receive_sema;
+  }
+}
+
+//----------------------------------------------------------------------
+// Transport::Open
+/*! 	Open the connection of a port. The same port must be opened on
+//	the other machine: the segments received on a port that is not
+//	opened are dropped, and sent again later by the other side.
+//
+//	\param port the port of the connection
+//	\return the port, or -1 if it is invalid or already opened
+*/
+//----------------------------------------------------------------------
+
+int
+Transport::Open(int port)
+{
+  if ((port < 0) || (port >= TRANSPORT_NB_PORTS) || conn[port].open)
+    return -1;
+  IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  TransportConnection *c = &conn[port];
+  c->send_base = c->send_next = 0;
+  c->srtt = c->rttvar = 0;
+  c->rto = TRANSPORT_INITIAL_RTO;
+  c->timer_start = 0;
+  c->nb_retries = 0;
+  c->failed = false;
+  c->receive_next = 0;
+  c->ack_pending = false;
+  c->receive_head = c->receive_count = 0;
+  c->open = true;
+  g_machine->interrupt->SetStatus(old);
+  if (!handler_set) {
+    handler_set = true;
+    g_acia_driver->SetReceiveHandler(TransportSegmentReceived);
+  }
+  DEBUG('i', (char*)"Transport: port %d opened\n", port);
+  return port;
+}
+
+//----------------------------------------------------------------------
+// Transport::Close
+/*! 	Close a connection, once all the data sent on it is
+//	acknowledged, or dropped because the other side did not
+//	acknowledge it after TRANSPORT_MAX_RETRIES timeouts (for
+//	instance because the port is not opened there).
+//
+//	\param port the port of the connection
+//	\return 0, -1 if the connection is not opened, or -2 if data
+//	was dropped
+*/
+//----------------------------------------------------------------------
+
+int
+Transport::Close(int port)
+{
+  if ((port < 0) || (port >= TRANSPORT_NB_PORTS) || !conn[port].open)
+    return -1;
+  TransportConnection *c = &conn[port];
+  c->send_lock->Acquire();
+  IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  while (c->send_base != c->send_next) {
+    c->window_waiting = true;
+    c->window_sema->P();
+  }
+  c->open = false;
+  bool failed = c->failed;
+  g_machine->interrupt->SetStatus(old);
+  c->send_lock->Release();
+  DEBUG('i', (char*)"Transport: port %d closed\n", port);
+  return failed ? -2 : 0;
+}
+
+//----------------------------------------------------------------------
+// Transport::Send
+/*! 	Send bytes on a connection. The bytes are cut into segments,
+//	which are sent as soon as the window allows it: the routine
+//	only waits when the window is full, not for the
+//	acknowledgments.
+//
+//	\param port the port of the connection
+//	\param buff the bytes to send
+//	\param len the number of bytes
+//	\return len, -1 if the connection is not opened, or -2 if it
+//	failed (see Close)
+*/
+//----------------------------------------------------------------------
+
+int
+Transport::Send(int port, char *buff, int len)
+{
+  if ((port < 0) || (port >= TRANSPORT_NB_PORTS) || !conn[port].open)
+    return -1;
+  TransportConnection *c = &conn[port];
+  c->send_lock->Acquire();
+  int done = 0;
+  while (done < len) {
+    int n = (len - done < TRANSPORT_MSS) ? len - done : TRANSPORT_MSS;
+    IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    while (!c->failed && SEQ(c->send_next - c->send_base) >= window) {
+      c->window_waiting = true;
+      c->window_sema->P();
+    }
+    if (c->failed) {
+      g_machine->interrupt->SetStatus(old);
+      c->send_lock->Release();
+      return -2;
+    }
+    int seq = c->send_next;
+    TransportSegment *s = &c->window[seq % TRANSPORT_MAX_WINDOW];
+    memcpy(s->data, buff + done, n);
+    s->len = n;
+    s->sent = g_stats->getTotalTicks();
+    s->retransmitted = false;
+    if (c->send_base == seq)
+      c->timer_start = s->sent;
+    c->send_next = SEQ(seq + 1);
+    nb_segments_sent++;
+    ArmTimer();
+    g_machine->interrupt->SetStatus(old);
+    Transmit(port, SEGMENT_DATA, seq, s->data, n, false);
+    done += n;
+  }
+  c->send_lock->Release();
+  return len;
+}
+
+//----------------------------------------------------------------------
+// Transport::Receive
+/*! 	Receive bytes from a connection, waiting until some are
+//	available.
+//
+//	\param port the port of the connection
+//	\param buff where to copy the bytes
+//	\param len the size of buff
+//	\return the number of bytes copied, or -1 if the connection is
+//	not opened
+*/
+//----------------------------------------------------------------------
+
+int
+Transport::Receive(int port, char *buff, int len)
+{
+  if ((port < 0) || (port >= TRANSPORT_NB_PORTS) || !conn[port].open)
+    return -1;
+  TransportConnection *c = &conn[port];
+  c->receive_lock->Acquire();
+  IntStatus old = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  while (c->receive_count == 0) {
+    c->receive_waiting = true;
+    c->receive_sema->P();
+  }
+  int n = (len < c->receive_count) ? len : c->receive_count;
+  for (int i = 0; i < n; i++)
+    buff[i] = c->receive_buffer[(c->receive_head + i) % TRANSPORT_RECV_SIZE];
+  c->receive_head = (c->receive_head + n) % TRANSPORT_RECV_SIZE;
+  c->receive_count -= n;
+  g_machine->interrupt->SetStatus(old);
+  c->receive_lock->Release();
+  return n;
+}
+
+//----------------------------------------------------------------------
+// Transport::SegmentReceived
+/*! 	Handle a segment received, at interrupt time. A data segment is
+//	accepted if it is the next one expected and there is room in the
+//	receive buffer, and is always answered by an ACK. An ACK
+//	releases the segments it acknowledges.
+//
+//	\param segment the segment
+//	\param len its size, header included
+*/
+//----------------------------------------------------------------------
+
+void
+Transport::SegmentReceived(char *segment, int len)
+{
+  if (len < SEGMENT_HEADER_SIZE) {
+    nb_bad_checksum++;
+    return;
+  }
+  int type = segment[0] & 0xff;
+  int port = segment[1] & 0xff;
+  int seq = ((segment[2] & 0xff) << 8) | (segment[3] & 0xff);
+  int data_len = ((segment[4] & 0xff) << 8) | (segment[5] & 0xff);
+  int checksum = ((segment[6] & 0xff) << 8) | (segment[7] & 0xff);
+  if ((data_len != len - SEGMENT_HEADER_SIZE)
+      || (port >= TRANSPORT_NB_PORTS)
+      || (Checksum(segment, len) != checksum)) {
+    DEBUG('i', (char*)"Transport: bad segment dropped\n");
+    nb_bad_checksum++;
+    return;
+  }
+  TransportConnection *c = &conn[port];
+  if (!c->open)
+    return;
+
+  if (type == SEGMENT_DATA) {
+    if (seq != c->receive_next)
+      nb_duplicates++;
+    else if (c->receive_count + data_len > TRANSPORT_RECV_SIZE)
+      nb_no_room++;
+    else {
+      char *data = segment + SEGMENT_HEADER_SIZE;
+      for (int i = 0; i < data_len; i++)
+	c->receive_buffer[(c->receive_head + c->receive_count + i)
+			  % TRANSPORT_RECV_SIZE] = data[i];
+      c->receive_count += data_len;
+      c->receive_next = SEQ(c->receive_next + 1);
+      nb_segments_received++;
+      nb_bytes_received += data_len;
+      if (c->receive_waiting) {
+	c->receive_waiting = false;
+	c->receive_sema->V();
+      }
+    }
+    SendAck(port);
+  }
+  else if (type == SEGMENT_ACK) {
+    int acked = SEQ(seq - c->send_base);
+    int outstanding = SEQ(c->send_next - c->send_base);
+    if ((acked == 0) || (acked > outstanding))
+      return;			// duplicated or stale ACK
+    Time now = g_stats->getTotalTicks();
+    TransportSegment *last = &c->window[SEQ(seq - 1) % TRANSPORT_MAX_WINDOW];
+    if (!last->retransmitted)
+      UpdateRto(c, now - last->sent);
+    for (int k = 0; k < acked; k++)
+      nb_bytes_sent +=
+	c->window[SEQ(c->send_base + k) % TRANSPORT_MAX_WINDOW].len;
+    c->send_base = seq;
+    c->timer_start = now;
+    c->nb_retries = 0;
+    if (c->window_waiting) {
+      c->window_waiting = false;
+      c->window_sema->V();
+    }
+  }
+  else
+    nb_bad_checksum++;
+}
+
+//----------------------------------------------------------------------
+// Transport::TimerHandler
+/*! 	Retransmission timer. Send again the ACKs that could not be
+//	sent, and the windows whose oldest segment timed out. The
+//	timeout is only doubled once segments were actually sent again:
+//	when the ACIA is busy, they are tried at the next period. After
+//	TRANSPORT_MAX_RETRIES timeouts in a row, the window is dropped
+//	and the connection fails. The timer is only armed while there
+//	are segments not acknowledged, so that Nachos can still halt
+//	when it is idle.
+*/
+//----------------------------------------------------------------------
+
+void
+Transport::TimerHandler()
+{
+  timer_armed = false;
+  Time now = g_stats->getTotalTicks();
+  bool busy = false;
+  for (int port = 0; port < TRANSPORT_NB_PORTS; port++) {
+    TransportConnection *c = &conn[port];
+    if (!c->open)
+      continue;
+    if (c->ack_pending)
+      SendAck(port);
+    int outstanding = SEQ(c->send_next - c->send_base);
+    if ((outstanding > 0) && (now - c->timer_start >= c->rto)
+	&& (c->nb_retries >= TRANSPORT_MAX_RETRIES)) {
+      DEBUG('i', (char*)"Transport: port %d failed, %d segments dropped\n",
+	    port, outstanding);
+      c->failed = true;
+      c->send_base = c->send_next;
+      outstanding = 0;
+      if (c->window_waiting) {
+	c->window_waiting = false;
+	c->window_sema->V();
+      }
+    }
+    if ((outstanding > 0) && (now - c->timer_start >= c->rto)) {
+      int sent = 0;
+      for (int k = 0; k < outstanding; k++) {
+	int seq = SEQ(c->send_base + k);
+	TransportSegment *s = &c->window[seq % TRANSPORT_MAX_WINDOW];
+	if (!Transmit(port, SEGMENT_DATA, seq, s->data, s->len, true))
+	  break;		// the ACIA is busy, next time
+	s->retransmitted = true;
+	s->sent = now;
+	nb_retransmits++;
+	sent++;
+      }
+      if (sent > 0) {
+	DEBUG('i', (char*)"Transport: timeout on port %d, %d segments sent again\n",
+	      port, sent);
+	nb_timeouts++;
+	c->nb_retries++;
+	c->rto = (2 * c->rto < TRANSPORT_MAX_RTO) ? 2 * c->rto : TRANSPORT_MAX_RTO;
+	c->timer_start = now;
+      }
+    }
+    if ((outstanding > 0) || c->ack_pending)
+      busy = true;
+  }
+  if (busy)
+    ArmTimer();
+}
+
+//----------------------------------------------------------------------
+// Transport::Print
+/*! 	Print the statistics of the transport.
+*/
+//----------------------------------------------------------------------
+
+void
+Transport::Print()
+{
+  printf("Transport send: window %d, %d segments, %d sent again (%d timeouts), "
+	 "%lld bytes acknowledged\n",
+	 window, nb_segments_sent, nb_retransmits, nb_timeouts,
+	 (long long)nb_bytes_sent);
+  printf("Transport receive: %d segments, %d out of order, %d no room, "
+	 "%d bad, %d ACKs sent, %lld bytes\n",
+	 nb_segments_received, nb_duplicates, nb_no_room, nb_bad_checksum,
+	 nb_acks_sent, (long long)nb_bytes_received);
+}
+
+//----------------------------------------------------------------------
+// Transport::Transmit
+/*! 	Build a segment and send it as an ACIA message.
+//
+//	\param now if true, do not wait for room in the ACIA send ring
+//	(at interrupt time), and give up if there is none
+//	\return true if the segment was sent
+*/
+//----------------------------------------------------------------------
+
+bool
+Transport::Transmit(int port, int type, int seq, char *data, int len, bool now)
+{
+  char segment[SEGMENT_HEADER_SIZE + TRANSPORT_MSS];
+  segment[0] = (char)type;
+  segment[1] = (char)port;
+  segment[2] = (char)((seq >> 8) & 0xff);
+  segment[3] = (char)(seq & 0xff);
+  segment[4] = (char)((len >> 8) & 0xff);
+  segment[5] = (char)(len & 0xff);
+  if (len > 0)
+    memcpy(segment + SEGMENT_HEADER_SIZE, data, len);
+  int checksum = Checksum(segment, SEGMENT_HEADER_SIZE + len);
+  segment[6] = (char)((checksum >> 8) & 0xff);
+  segment[7] = (char)(checksum & 0xff);
+  if (now)
+    return g_acia_driver->SendMessageNow(segment, SEGMENT_HEADER_SIZE + len);
+  return g_acia_driver->SendMessage(segment, SEGMENT_HEADER_SIZE + len) >= 0;
+}
+
+//----------------------------------------------------------------------
+// Transport::SendAck
+/*! 	Acknowledge the segments received on a connection. At
+//	interrupt time, so the ACK is sent later by the timer if the
+//	ACIA send ring is full.
+*/
+//----------------------------------------------------------------------
+
+void
+Transport::SendAck(int port)
+{
+  TransportConnection *c = &conn[port];
+  if (Transmit(port, SEGMENT_ACK, c->receive_next, NULL, 0, true)) {
+    c->ack_pending = false;
+    nb_acks_sent++;
+  } else {
+    c->ack_pending = true;
+    ArmTimer();
+  }
+}
+
+//----------------------------------------------------------------------
+// Transport::UpdateRto
+/*! 	Update the round-trip time estimate and the retransmission
+//	timeout of a connection with a new sample.
+*/
+//----------------------------------------------------------------------
+
+void
+Transport::UpdateRto(TransportConnection *c, Time sample)
+{
+  if (sample <= 0)
+    sample = 1;
+  if (c->srtt == 0) {
+    c->srtt = sample;
+    c->rttvar = sample / 2;
+  } else {
+    Time delta = (c->srtt > sample) ? c->srtt - sample : sample - c->srtt;
+    c->rttvar = (3 * c->rttvar + delta) / 4;
+    c->srtt = (7 * c->srtt + sample) / 8;
+  }
+  c->rto = c->srtt + 4 * c->rttvar;
+  if (c->rto < TRANSPORT_MIN_RTO)
+    c->rto = TRANSPORT_MIN_RTO;
+  if (c->rto > TRANSPORT_MAX_RTO)
+    c->rto = TRANSPORT_MAX_RTO;
+}
+
+//----------------------------------------------------------------------
+// Transport::ArmTimer
+/*! 	Schedule the retransmission timer, if it is not already.
+//	Interrupts must be disabled.
+*/
+//----------------------------------------------------------------------
+
+void
+Transport::ArmTimer()
+{
+  if (timer_armed)
+    return;
+  timer_armed = true;
+  g_machine->interrupt->Schedule(TransportTimer, (int64_t)this,
+				 TRANSPORT_TIMER_PERIOD, TIMER_INT);
+}
+
+//----------------------------------------------------------------------
+// Transport::Checksum
+/*! 	Compute the checksum of a segment: the one's complement of the
+//	one's complement sum of its 16-bit words, the checksum field
+//	being taken as zero.
+*/
+//----------------------------------------------------------------------
+
+int
+Transport::Checksum(char *segment, int len)
+{
+  const int field = SEGMENT_HEADER_SIZE - 2;	// offset of the checksum
+  uint32_t sum = 0;
+  for (int i = 0; i < len; i += 2) {
+    if (i == field)
+      continue;
+    int hi = segment[i] & 0xff;
+    int lo = (i + 1 < len) ? segment[i + 1] & 0xff : 0;
+    sum += (hi << 8) | lo;
+  }
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (~sum) & 0xffff;
+}
@@ -0,0 +1,149 @@
+/*! \file transport.h
+    \brief Data structures of the reliable transport over the ACIA
+
+    The transport provides reliable byte streams, called connections,
+    between the two Nachos machines linked by the serial line. Each
+    connection is identified by a port number, opened on both
+    machines. The data is cut into segments carrying a sequence
+    number and a checksum; the receiver acknowledges them with
+    cumulative ACKs. Up to a window of segments are sent ahead of the
+    acknowledgments, so that the link is kept busy, and the segments
+    not acknowledged in time are sent again (go-back-N).
+
+    Once a connection is opened, the serial line carries transport
+    segments only: TtySend and TtyReceive must not be used anymore.
+
+    Copyright (c) 1999-2000 INSA de Rennes.
+    All rights reserved.
+    See copyright_insa.h for copyright notice and limitation
+    of liability and disclaimer of warranty provisions.
+*/
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "kernel/synch.h"
+#include "drivers/drvACIA.h"
+
+#define TRANSPORT_NB_PORTS 8        // number of connections
+#define TRANSPORT_MSS 256           // maximum data bytes in a segment
+#define TRANSPORT_MAX_WINDOW 32     // maximum window, in segments
+#define TRANSPORT_DEFAULT_WINDOW 8  // window when not configured
+#define TRANSPORT_RECV_SIZE 4096    // receive buffer of a connection
+
+//! Retransmission timeout: initial value and bounds, in ticks. The
+//! timeout is then computed from the measured round-trip times.
+#define TRANSPORT_INITIAL_RTO 100000
+#define TRANSPORT_MIN_RTO 5000
+#define TRANSPORT_MAX_RTO 1000000
+
+//! Period of the retransmission timer, in ticks
+#define TRANSPORT_TIMER_PERIOD 5000
+
+//! Timeouts in a row after which the other side is considered gone:
+//! the data not acknowledged is dropped and the connection fails
+#define TRANSPORT_MAX_RETRIES 8
+
+// A segment is a header followed by its data. The header holds the
+// type, the port, the sequence number (or for an ACK, the next
+// sequence number expected), the data length and the checksum;
+// 16-bit values are sent most significant byte first.
+#define SEGMENT_DATA 1
+#define SEGMENT_ACK 2
+#define SEGMENT_HEADER_SIZE 8
+
+/*! \brief Defines a segment kept until it is acknowledged */
+typedef struct {
+  int len;                  //!< Number of data bytes
+  Time sent;                //!< Tick of the last transmission
+  bool retransmitted;       //!< Sent more than once (no RTT sample)
+  char data[TRANSPORT_MSS]; //!< Data of the segment
+} TransportSegment;
+
+/*! \brief Defines the state of a connection */
+typedef struct {
+  bool open;                //!< The port is opened on this machine
+  Lock *send_lock;          //!< One sender at a time
+  Lock *receive_lock;       //!< One receiver at a time
+
+  int send_base;            //!< Oldest sequence number not acknowledged
+  int send_next;            //!< Next sequence number to send
+  TransportSegment window[TRANSPORT_MAX_WINDOW];
+                            //!< Segments not acknowledged yet
+  bool window_waiting;      //!< A sender waits for the window to move
+  Semaphore *window_sema;   //!< V'ed when the window moves
+  Time srtt;                //!< Smoothed round-trip time (0 if unknown)
+  Time rttvar;              //!< Round-trip time variation
+  Time rto;                 //!< Current retransmission timeout
+  Time timer_start;         //!< Start of the current timeout
+  int nb_retries;           //!< Timeouts in a row, without any ACK
+  bool failed;              //!< Data dropped after too many timeouts
+
+  int receive_next;         //!< Next sequence number expected
+  bool ack_pending;         //!< An ACK could not be sent yet
+  char receive_buffer[TRANSPORT_RECV_SIZE];
+                            //!< Data received, not read yet
+  int receive_head;         //!< Index of the first byte to read
+  int receive_count;        //!< Number of bytes to read
+  bool receive_waiting;     //!< A receiver waits for data
+  Semaphore *receive_sema;  //!< V'ed when data arrives
+} TransportConnection;
+
+/*! \brief Defines the reliable transport over the serial line */
+class Transport {
+public:
+  //! Constructor. All the connections are closed
+  Transport();
+
+  //! Destructor
+  ~Transport();
+
+  //! Open the connection of a port
+  int Open(int port);
+
+  //! Close a connection, once all its data is acknowledged
+  int Close(int port);
+
+  //! Send len bytes on a connection
+  int Send(int port, char *buff, int len);
+
+  //! Receive at most len bytes from a connection
+  int Receive(int port, char *buff, int len);
+
+  //! Handle a segment received (interrupt time)
+  void SegmentReceived(char *segment, int len);
+
+  //! Retransmission timer handler (interrupt time)
+  void TimerHandler();
+
+  //! Print the statistics of the transport
+  void Print();
+
+private:
+  bool Transmit(int port, int type, int seq, char *data, int len, bool now);
+  void SendAck(int port);
+  void UpdateRto(TransportConnection *c, Time sample);
+  void ArmTimer();
+  static int Checksum(char *segment, int len);
+
+  TransportConnection conn[TRANSPORT_NB_PORTS]; //!< The connections
+  int window;               //!< Window of the connections, in segments
+  bool timer_armed;         //!< The retransmission timer is scheduled
+  bool handler_set;         //!< The ACIA passes us the messages
+
+  int nb_segments_sent;     //!< Data segments sent for the first time
+  int nb_retransmits;       //!< Data segments sent again
+  int nb_timeouts;          //!< Retransmission timeouts
+  int nb_acks_sent;         //!< ACKs sent
+  int nb_segments_received; //!< Data segments accepted
+  int nb_duplicates;        //!< Data segments out of order or duplicated
+  int nb_no_room;           //!< Data segments dropped (receive buffer full)
+  int nb_bad_checksum;      //!< Segments dropped (bad checksum or header)
+  int64_t nb_bytes_sent;    //!< Data bytes acknowledged
+  int64_t nb_bytes_received; //!< Data bytes accepted
+};
+
+void TransportSegmentReceived(char *msg, int len);
+void TransportTimer(int64_t arg);
+
+#endif // TRANSPORT_H
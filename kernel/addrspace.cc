@@ -57,6 +57,7 @@
 
 static void CheckELFHeader (Elf32_Ehdr *ehdr,int *err);
 static void SwapELFSectionHeader (Elf32_Shdr *shdr);
+static bool UsesFloatingPoint (OpenFile *exec_file, Elf32_Shdr *shdr);
 
 //----------------------------------------------------------------------
 /** 	Create an address space to run a user program.
@@ -88,6 +89,7 @@ AddrSpace::AddrSpace(OpenFile * exec_file, Process *p, int *err) {
     translationTable = NULL;
     freePageId = 0;
     process = p;
+    CodeLowAddress = CodeHighAddress = 0;
 
     /* Empty user address space requested ? */
     if (exec_file == NULL) {
@@ -158,6 +160,25 @@ AddrSpace::AddrSpace(OpenFile * exec_file, Process *p, int *err) {
         if (!(section_table[i].sh_flags & SHF_ALLOC))
             continue;
 
+        // Look for floating point instructions in the code, so that
+        // the floating point registers of the threads of processes
+        // that have none are never switched
+        if ((section_table[i].sh_flags & SHF_EXECINSTR)
+            && (section_table[i].sh_type != SHT_NOBITS)
+            && UsesFloatingPoint(exec_file, &section_table[i]))
+            process->uses_fp = true;
+
+        // Bounds of the code, to check the user code addresses
+        // given to the kernel (see Upcall)
+        if (section_table[i].sh_flags & SHF_EXECINSTR) {
+            int32_t low = section_table[i].sh_addr;
+            int32_t high = low + section_table[i].sh_size;
+            if ((CodeHighAddress == 0) || (low < CodeLowAddress))
+                CodeLowAddress = low;
+            if (high > CodeHighAddress)
+                CodeHighAddress = high;
+        }
+
         printf("\t- Section %s : file offset 0x%x, size 0x%x, addr 0x%x, %s%s\n",
             section_name,
             (unsigned)section_table[i].sh_offset,
@@ -637,3 +658,79 @@ CheckELFHeader (Elf32_Ehdr *elfHdr, int *err)
 
 
 }
+
+
+
+
+
+//----------------------------------------------------------------------
+
+// UsesFloatingPoint
+
+/*! 	Tell whether a code section of the executable file holds
+
+//	floating point instructions (coprocessor 1 operations and loads
+
+//	and stores, or moves on its condition codes).
+
+//
+
+// \param exec_file the executable file
+
+// \param shdr pointer to the header of the section (host byte order)
+
+// \return true if the section holds a floating point instruction
+
+*/
+
+//----------------------------------------------------------------------
+
+static bool
+
+UsesFloatingPoint (OpenFile *exec_file, Elf32_Shdr *shdr)
+
+{
+
+  int nb_words = shdr->sh_size / 4;
+
+  uint32_t *code = new uint32_t[nb_words];
+
+  exec_file->ReadAt((char *) code, nb_words * 4, shdr->sh_offset);
+
+
+
+  bool found = false;
+
+  for (int i = 0; (i < nb_words) && !found; i++) {
+
+    uint32_t instr = WordToHost(code[i]);
+
+    switch (instr >> 26) {
+
+    case 0x11:                  // COP1
+
+    case 0x13:                  // COP1X
+
+    case 0x31: case 0x35:       // LWC1, LDC1
+
+    case 0x39: case 0x3d:       // SWC1, SDC1
+
+      found = true;
+
+      break;
+
+    case 0x00:                  // MOVCI (SPECIAL, function 1)
+
+      found = ((instr & 0x3f) == 0x01);
+
+      break;
+
+    }
+
+  }
+
+  delete [] code;
+
+  return found;
+
+}
@@ -176,6 +176,20 @@ public:
 
 
 
+  /** Tell whether an address is an instruction of the code loaded
+
+    from the ELF file (between the first and the last executable
+
+    sections, word aligned) */
+
+  bool isCodeAddress(int32_t addr)
+
+  { return (addr >= CodeLowAddress) && (addr < CodeHighAddress)
+
+      && (addr % 4 == 0); }
+
+
+
   /*! Translation table. This table will be discovered in the virtual
 
     memory assignement, and is used to know where virtual pages are
@@ -222,6 +236,14 @@ private:
 
 
 
+  //* Bounds of the executable sections (empty without any)
+
+  int32_t CodeLowAddress;
+
+  int32_t CodeHighAddress;
+
+
+
   /**  Allocate numPages virtual pages in the current address space
 
    //
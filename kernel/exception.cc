@@ -22,12 +22,26 @@
 #include "kernel/system.h"
 #include "userlib/syscall.h"
 #include "kernel/synch.h"
+#include "kernel/scheduler.h"
+#include "kernel/timerwheel.h"
 #include "drivers/drvACIA.h"
+#include "drivers/transport.h"
 #include "drivers/drvConsole.h"
 #include "filesys/oftable.h"
 #include "vm/pagefaultmanager.h"
 #include "utility/objid.h"
 
+// The priorities of userlib/syscall.h are the levels of the scheduler
+// (SC_NICE uses them as indexes of the ready lists): fail to compile
+// if they drift apart
+typedef char check_sched_lowest_priority
+  [(SCHED_LOWEST_PRIORITY == SCHED_NB_LEVELS - 1) ? 1 : -1];
+
+// Same for the default weight of the processes, which SC_WEIGHT
+// returns as the previous weight of a process that never changed it
+typedef char check_weight_default
+  [(WEIGHT_DEFAULT == SCHED_DEFAULT_WEIGHT) ? 1 : -1];
+
 //----------------------------------------------------------------------
 // GetLengthParam
 /*! Returns the length of a string stored in the machine memory,
@@ -143,7 +157,7 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
 	  // Ends the calling thread
 	  DEBUG('e', (char*)"Thread 0x%x %s exit call.\n", g_current_thread,g_current_thread->GetName());
 	  ASSERT(g_current_thread->type == THREAD_TYPE);
-	  g_current_thread->Finish();
+	  g_current_thread->Finish(g_machine->ReadIntRegister(4));
 	  break;
         }
 
@@ -237,9 +251,9 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
 	  if (ptThread
 	      && ptThread->type == THREAD_TYPE)
 	    {
-	      g_current_thread->Join(ptThread);
+	      int status = g_current_thread->Join(ptThread);
 	      g_syscall_error->SetMsg((char*)"",NO_ERROR);
-	      g_machine->WriteIntRegister(2,0);
+	      g_machine->WriteIntRegister(2,status);
 	    }
 	  else
 	    // Thread already terminated (type set to INVALID_TYPE) or call on an object
@@ -256,7 +270,17 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
 	case SC_YIELD: {
 	  DEBUG('e', (char*)"Process or thread: Yield call.\n");
 	  ASSERT(g_current_thread->type == THREAD_TYPE);
-	  g_current_thread->Yield();
+	  {
+	    // A real-time thread that yields completes its job, and
+	    // waits for its next period
+	    IntStatus old_status =
+	      g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+	    if (g_scheduler->EndOfJob(g_current_thread))
+	      g_current_thread->Sleep();
+	    else
+	      g_current_thread->Yield();
+	    g_machine->interrupt->SetStatus(old_status);
+	  }
 	  g_syscall_error->SetMsg((char*)"",NO_ERROR);
 	  break;
 	}
@@ -366,11 +390,13 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
          }
          // Read on the console
          else {
-           g_console_driver->GetString(buffer,size);
-           numread = size;
+           numread = g_console_driver->GetString(buffer,size);
            g_syscall_error->SetMsg((char*)"",NO_ERROR);
          }
-         for (int i=0;i<numread;i++)
+         // also copy the '\0' ending the string read on the console
+         int numcopy = numread;
+         if ((f == CONSOLE_INPUT) && (numread < size)) numcopy++;
+         for (int i=0;i<numcopy;i++)
            { //copy the buffer into the emulator memory
              g_machine->mmu->WriteMem(addr++,1,buffer[i]);
            }
@@ -579,13 +605,14 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
 	    uint32_t c;
 	    int i;
 	    uint32_t addr=g_machine->ReadIntRegister(4);
-	    char buff[MAXSTRLEN];
-	    for(i=0;;i++)
+	    char buff[ACIA_MAX_MSG+1];
+	    for(i=0;i<ACIA_MAX_MSG;i++)
 	      {
 		g_machine->mmu->ReadMem(addr+i,1,&c,false);
 		buff[i]=(char) c;
 		if (buff[i] == '\0') break;
 	      }
+	    buff[i]='\0';	// longer messages are truncated
 	    result=g_acia_driver->TtySend(buff);
 	    g_machine->WriteIntRegister(2,result);
 	    g_syscall_error->SetMsg((char*)"",NO_ERROR);
@@ -608,12 +635,14 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
 	    int length=g_machine->ReadIntRegister(5);
 	    char buff[length+1];
 	    result=g_acia_driver->TtyReceive(buff,length);
-	    while ((i <= length)) {
+	    while ((i < result)) {
 	      g_machine->mmu->WriteMem(addr,1,buff[i]);
 	      addr++;
 	      i++;
 	    }
-	    g_machine->mmu->WriteMem(addr,1,0);
+	    // terminate the message when there is room left
+	    if (result < length)
+	      g_machine->mmu->WriteMem(addr,1,0);
 	    g_machine->WriteIntRegister(2,result);
 	    g_syscall_error->SetMsg((char*)"",NO_ERROR);
 	  }
@@ -812,6 +841,254 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
       break;
     }
 
+    case SC_CONSOLE_MODE:{
+      // Choose the input mode of the console: canonical (line) mode
+      // or raw mode
+      int mode = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"ConsoleMode call (%d).\n", mode);
+      if (mode != CONSOLE_CANONICAL && mode != CONSOLE_RAW) {
+	sprintf(msg,"%d",mode);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_CONSOLE_MODE);
+      } else {
+	bool previous =
+	  g_console_driver->SetCanonical(mode == CONSOLE_CANONICAL);
+	g_machine->WriteIntRegister(2,previous ? CONSOLE_CANONICAL : CONSOLE_RAW);
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_IO_PRIORITY:{
+      // Set the I/O priority class of the calling process, so that
+      // batch jobs can put themselves in the background class
+      int prio = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"IoPriority call (%d).\n", prio);
+      Process *process = g_current_thread->GetProcessOwner();
+      if (prio != IO_PRIO_INTERACTIVE && prio != IO_PRIO_BACKGROUND) {
+	sprintf(msg,"%d",prio);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_PRIORITY);
+      } else {
+	g_machine->WriteIntRegister(2,process->io_priority);
+	process->io_priority = prio;
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_QUANTUM:{
+      // Set the time quantum of the calling process
+      int ticks = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"Quantum call (%d).\n", ticks);
+      Process *process = g_current_thread->GetProcessOwner();
+      if (ticks < 0) {
+	sprintf(msg,"%d",ticks);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_QUANTUM);
+      } else {
+	g_machine->WriteIntRegister(2,process->quantum);
+	process->quantum = ticks;
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_NICE:{
+      // Set the base scheduling priority of the calling process
+      int prio = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"Nice call (%d).\n", prio);
+      Process *process = g_current_thread->GetProcessOwner();
+      if (prio < SCHED_HIGHEST_PRIORITY || prio > SCHED_LOWEST_PRIORITY) {
+	sprintf(msg,"%d",prio);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_PRIORITY);
+      } else {
+	g_machine->WriteIntRegister(2,process->priority);
+	process->priority = prio;
+	// the calling thread takes the new priority at once, the
+	// others when they are next put in the ready list
+	g_current_thread->sched.level = prio;
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_REALTIME:{
+      // Move the calling thread in or out of the real-time class
+      int period = g_machine->ReadIntRegister(4);
+      int budget = g_machine->ReadIntRegister(5);
+      DEBUG('e', (char*)"RealTime call (%d, %d).\n", period, budget);
+      sprintf(msg,"%d/%d",budget,period);
+      if ((period < 0)
+	  || ((period > 0) && ((budget <= 0) || (budget > period)))) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_REALTIME);
+      } else if (!g_scheduler->SetRealTime(g_current_thread,period,budget)) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,REALTIME_REFUSED);
+      } else {
+	g_machine->WriteIntRegister(2,0);
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_WEIGHT:{
+      // Set the weight of the calling process
+      int weight = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"Weight call (%d).\n", weight);
+      Process *process = g_current_thread->GetProcessOwner();
+      if (weight <= 0 || weight > WEIGHT_MAX) {
+	sprintf(msg,"%d",weight);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_WEIGHT);
+      } else {
+	g_machine->WriteIntRegister(2,process->weight);
+	process->weight = weight;
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_SLEEP:{
+      // Put the calling thread to sleep for a number of ticks
+      int ticks = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"Sleep call (%d).\n", ticks);
+      if (ticks < 0) {
+	sprintf(msg,"%d",ticks);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_DELAY);
+      } else {
+	g_timer_wheel->Sleep(ticks);
+	g_machine->WriteIntRegister(2,0);
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_UPCALL:{
+      // Register the user-level thread runtime of the process
+      int handler = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"Upcall call (0x%x).\n", handler);
+      Process *process = g_current_thread->GetProcessOwner();
+      if ((handler != 0) && !process->addrspace->isCodeAddress(handler)) {
+	sprintf(msg,"0x%x",handler);
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_UPCALL);
+	break;
+      }
+      process->SetUpcall(handler);
+      g_machine->WriteIntRegister(2,0);
+      g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      break;
+    }
+
+    case SC_CONN_OPEN:{
+      // Open a reliable connection over the serial link
+      int port = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"ConnOpen call (%d).\n", port);
+      sprintf(msg,"%d",port);
+      if (g_transport == NULL) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,NO_ACIA);
+      } else if (g_transport->Open(port) < 0) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,INVALID_CONNECTION);
+      } else {
+	g_machine->WriteIntRegister(2,port);
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_CONN_CLOSE:{
+      // Close a connection, once its data is acknowledged
+      int conn = g_machine->ReadIntRegister(4);
+      DEBUG('e', (char*)"ConnClose call (%d).\n", conn);
+      sprintf(msg,"%d",conn);
+      if (g_transport == NULL) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,NO_ACIA);
+	break;
+      }
+      int result = g_transport->Close(conn);
+      if (result < 0) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,(result == -1) ? INVALID_CONNECTION
+				: CONNECTION_TIMEOUT);
+      } else {
+	g_machine->WriteIntRegister(2,0);
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      }
+      break;
+    }
+
+    case SC_CONN_SEND:{
+      // Send bytes on a connection
+      int conn = g_machine->ReadIntRegister(4);
+      uint32_t addr = g_machine->ReadIntRegister(5);
+      int size = g_machine->ReadIntRegister(6);
+      DEBUG('e', (char*)"ConnSend call (%d, %d bytes).\n", conn, size);
+      sprintf(msg,"%d",conn);
+      if (g_transport == NULL) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,NO_ACIA);
+	break;
+      }
+      if (size < 0) size = 0;
+      // the user bytes are copied one segment at a time, whatever
+      // the size asked for
+      char buffer[TRANSPORT_MSS];
+      uint32_t c;
+      int result = 0;
+      int done = 0;
+      while ((result >= 0) && (done < size)) {
+	int n = (size - done < TRANSPORT_MSS) ? size - done : TRANSPORT_MSS;
+	for (int i=0;i<n;i++) {
+	  g_machine->mmu->ReadMem(addr++,1,&c,false);
+	  buffer[i] = c;
+	}
+	result = g_transport->Send(conn,buffer,n);
+	done += n;
+      }
+      if (result >= 0) result = size;
+      g_machine->WriteIntRegister(2,(result < 0) ? ERROR : result);
+      if (result < 0)
+	g_syscall_error->SetMsg(msg,(result == -1) ? INVALID_CONNECTION
+				: CONNECTION_TIMEOUT);
+      else
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      break;
+    }
+
+    case SC_CONN_RECEIVE:{
+      // Receive bytes from a connection
+      int conn = g_machine->ReadIntRegister(4);
+      int addr = g_machine->ReadIntRegister(5);
+      int size = g_machine->ReadIntRegister(6);
+      DEBUG('e', (char*)"ConnReceive call (%d, %d bytes).\n", conn, size);
+      sprintf(msg,"%d",conn);
+      if (g_transport == NULL) {
+	g_machine->WriteIntRegister(2,ERROR);
+	g_syscall_error->SetMsg(msg,NO_ACIA);
+	break;
+      }
+      // at most one segment is returned at a time
+      if (size < 0) size = 0;
+      if (size > TRANSPORT_MSS) size = TRANSPORT_MSS;
+      char buffer[TRANSPORT_MSS];
+      int result = g_transport->Receive(conn,buffer,size);
+      for (int i=0;i<result;i++)
+	g_machine->mmu->WriteMem(addr++,1,buffer[i]);
+      g_machine->WriteIntRegister(2,result);
+      if (result < 0)
+	g_syscall_error->SetMsg(msg,INVALID_CONNECTION);
+      else
+	g_syscall_error->SetMsg((char*)"",NO_ERROR);
+      break;
+    }
+
     default:
         printf("Invalid system call number : %d\n", type);
         exit(ERROR);
@@ -883,4 +1160,15 @@ void ExceptionHandler(ExceptionType exceptiontype, int vaddr)
     g_machine->interrupt->Halt(ERROR);
     break;
   }
+
+  // Back to user mode: a virtual processor that gave up the right to
+  // run user code while blocked waits for it here, where it holds no
+  // kernel lock or state anymore
+  if (g_current_thread->vp) {
+    Process *process = g_current_thread->GetProcessOwner();
+    IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    if (process->vp_active != g_current_thread)
+      process->AcquireProcessor(g_current_thread);
+    g_machine->interrupt->SetStatus(oldLevel);
+  }
  }
@@ -92,6 +92,26 @@ SyscallError::SyscallError() {
 
   msgs[NO_ACIA] = (char*)"no ACIA driver installed %s\n";
 
+  msgs[INVALID_PRIORITY] = (char*)"invalid priority %s\n";
+
+  msgs[INVALID_CONSOLE_MODE] = (char*)"invalid console mode %s\n";
+
+  msgs[INVALID_CONNECTION] = (char*)"invalid connection %s\n";
+
+  msgs[INVALID_QUANTUM] = (char*)"invalid time quantum %s\n";
+
+  msgs[INVALID_REALTIME] = (char*)"invalid real-time budget/period %s\n";
+
+  msgs[REALTIME_REFUSED] = (char*)"real-time utilization over 100%% with %s\n";
+
+  msgs[INVALID_WEIGHT] = (char*)"invalid weight %s\n";
+
+  msgs[INVALID_DELAY] = (char*)"invalid delay %s\n";
+
+  msgs[CONNECTION_TIMEOUT] = (char*)"connection %s: data not acknowledged, dropped\n";
+
+  msgs[INVALID_UPCALL] = (char*)"upcall handler %s is not in the code\n";
+
 }
 
 
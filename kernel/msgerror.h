@@ -92,6 +92,26 @@ enum
 
   NO_ACIA,
 
+  INVALID_PRIORITY,
+
+  INVALID_CONSOLE_MODE,
+
+  INVALID_CONNECTION,
+
+  INVALID_QUANTUM,
+
+  INVALID_REALTIME,
+
+  REALTIME_REFUSED,
+
+  INVALID_WEIGHT,
+
+  INVALID_DELAY,
+
+  CONNECTION_TIMEOUT,
+
+  INVALID_UPCALL,
+
 
 
   NUMMSGERROR /* Must always be last */
@@ -12,6 +12,10 @@
 
 #include "kernel/process.h"
 
+#include "drivers/drvDisk.h"
+
+#include "kernel/scheduler.h"
+
 
 
 //----------------------------------------------------------------------
@@ -40,6 +44,30 @@ Process::Process(char *filename, int *err)
 
   numThreads=0;
 
+  io_priority = DISK_PRIO_INTERACTIVE;
+
+  quantum = 0;
+
+  priority = 0;
+
+  uses_fp = false;
+
+  weight = SCHED_DEFAULT_WEIGHT;
+
+  vruntime = 0;
+
+  vruntime_rest = 0;
+
+  min_vruntime = 0;
+
+  upcall = 0;
+
+  vp_active = NULL;
+
+  vp_waiting = new Listint;
+
+  nb_upcalls = 0;
+
   *err = NO_ERROR;
 
   if (filename == NULL)
@@ -90,6 +118,8 @@ Process::Process(char *filename, int *err)
 
       strcpy(name,filename);
 
+      weight = Scheduler::DefaultWeight(filename);
+
 
 
       // Open executable
@@ -168,6 +198,8 @@ Process::~Process()
 
   delete [] name;
 
+  delete vp_waiting;
+
 
 
   if (exec_file != NULL) {
@@ -184,3 +216,139 @@ Process::~Process()
 
 }
 
+
+
+//----------------------------------------------------------------------
+
+// Process::SetUpcall
+
+/*!   Register the entry point of the user-level thread runtime of the
+
+//    process, and start a virtual processor there if none may run
+
+//    user code.
+
+//
+
+//    \param handler is the address of the entry point (0: unregister)
+
+*/
+
+//----------------------------------------------------------------------
+
+void Process::SetUpcall(int handler)
+
+{
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  upcall = handler;
+
+  if ((upcall != 0) && (vp_active == NULL) && vp_waiting->IsEmpty())
+
+    ReleaseProcessor(NULL, true);
+
+  g_machine->interrupt->SetStatus(oldLevel);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Process::ReleaseProcessor
+
+/*!   Give the right to run user code to the first virtual processor
+
+//    back from a block, or else to a new virtual processor started at
+
+//    the upcall. Called with interrupts disabled, when the virtual
+
+//    processor holding the right blocks or finishes.
+
+//
+
+//    \param vp is the virtual processor giving up the right (NULL if
+
+//    none holds it)
+
+//    \param upcall is false if no virtual processor must be started
+
+*/
+
+//----------------------------------------------------------------------
+
+void Process::ReleaseProcessor(Thread *vp, bool upcall)
+
+{
+
+  ASSERT(vp_active == vp);
+
+  vp_active = NULL;
+
+  if (!vp_waiting->IsEmpty()) {
+
+    vp_active = (Thread *)vp_waiting->Remove();
+
+    g_scheduler->ReadyToRun(vp_active);
+
+  } else if (upcall && (this->upcall != 0)) {
+
+    DEBUG('t', (char *)"Upcall: new virtual processor in process %s\n",
+
+	  name);
+
+    Thread *thread = new Thread((char *)"upcall");
+
+    thread->vp = true;
+
+    vp_active = thread;
+
+    nb_upcalls++;
+
+    thread->Start(this, this->upcall, nb_upcalls);
+
+  }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Process::AcquireProcessor
+
+/*!   Wait until a virtual processor back from a block may run user
+
+//    code again. Called with interrupts disabled, on the return to
+
+//    user mode, once the kernel path that blocked is over.
+
+//
+
+//    \param vp is the virtual processor (the current thread)
+
+*/
+
+//----------------------------------------------------------------------
+
+void Process::AcquireProcessor(Thread *vp)
+
+{
+
+  if (vp_active == NULL) {
+
+    vp_active = vp;
+
+    return;
+
+  }
+
+  vp_waiting->Append((void *)vp);
+
+  vp->Sleep();
+
+  ASSERT(vp_active == vp);
+
+}
+
@@ -30,6 +30,8 @@
 
 #include "utility/stats.h"
 
+#include <map>
+
 
 
 class AddrSpace;
@@ -42,7 +44,25 @@ class Semaphore;
 
 /*! \brief Defines the data structures to keep track of the execution
 
- environment of a user program */
+ environment of a user program
+
+
+
+ A process may run a user-level thread runtime (see Upcall in
+
+ userlib/syscall.h), which multiplexes its threads over kernel threads
+
+ called virtual processors. At most one virtual processor of the
+
+ process runs user code at a time, so that the runtime needs no lock:
+
+ when it blocks in the kernel, it hands this right over to a virtual
+
+ processor back from a block, or to a new one started at the entry
+
+ point of the runtime (upcall). A virtual processor back from a block
+
+ waits for the right before returning to user mode. */
 
 class Process {
 
@@ -88,6 +108,130 @@ public:
 
 
 
+  int io_priority;                    /*!< I/O priority class of the
+
+                                        disk requests of the process
+
+                                        (see DiskPriority) */
+
+
+
+  int quantum;                        /*!< Time quantum of the threads
+
+                                        of the process, in ticks (0:
+
+                                        TimeQuantum of the
+
+                                        configuration) */
+
+
+
+  int priority;                       /*!< Base scheduling priority of
+
+                                        the threads of the process
+
+                                        (0: highest, see
+
+                                        SCHED_NB_LEVELS) */
+
+
+
+  bool uses_fp;                       /*!< The code of the program has
+
+                                        floating point instructions */
+
+
+
+  int weight;                         /*!< Share of the CPU of the
+
+                                        process (Fair policy, see
+
+                                        SCHED_DEFAULT_WEIGHT) */
+
+
+
+  int64_t vruntime;                   /*!< CPU time used, divided by
+
+                                        the weight (Fair policy) */
+
+
+
+  int64_t vruntime_rest;              /*!< Remainder of the division of
+
+                                        the CPU time by the weight, not
+
+                                        charged to vruntime yet */
+
+  int64_t min_vruntime;               /*!< Virtual run time of the
+
+                                        threads that become ready */
+
+
+
+  std::multimap<int64_t,Thread*> fair_ready;
+
+                                      /*!< Threads ready to run, by
+
+                                        virtual run time */
+
+
+
+  std::multimap<int64_t,Process*>::iterator fair_pos;
+
+                                      /*!< Position in the ready list
+
+                                        of the scheduler */
+
+
+
+  int upcall;                         /*!< Entry point of the user-level
+
+                                        thread runtime, started on a
+
+                                        new thread when the running
+
+                                        virtual processor blocks (0:
+
+                                        none) */
+
+  Thread *vp_active;                  /*!< Virtual processor allowed to
+
+                                        run user code (NULL: none) */
+
+  Listint *vp_waiting;                /*!< Virtual processors back from
+
+                                        a block, waiting to run user
+
+                                        code */
+
+  int nb_upcalls;                     /*!< Number of virtual processors
+
+                                        started */
+
+
+
+  /*! Register the user-level thread runtime of the process, and start
+
+      a virtual processor if none runs */
+
+  void SetUpcall(int handler);
+
+
+
+  /*! Let another virtual processor run user code: a waiting one, or a
+
+      new one started at the upcall if upcall is true */
+
+  void ReleaseProcessor(Thread *vp, bool upcall);
+
+
+
+  /*! Wait until a virtual processor may run user code again */
+
+  void AcquireProcessor(Thread *vp);
+
+
+
   char * getName() {return(name);}    /*!< Returns the process name */
 
 
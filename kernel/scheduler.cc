@@ -22,7 +22,37 @@
 
 //
 
-// 	Very simple implementation -- no priorities, straight FIFO.
+// 	Multi-level feedback queue: FIFO inside each level, the highest
+
+//	non-empty level first. A running thread is preempted at the end
+
+//	of its time quantum, if another thread is ready: the quantum is
+
+//	TimeQuantum ticks in the configuration, or set per process, and
+
+//	doubles at each level down.
+
+//
+
+//	With the Fair policy (ThreadScheduler in the configuration), the
+
+//	CPU is shared between the processes by weight instead: the
+
+//	process of least virtual run time runs its thread of least
+
+//	virtual run time. Both are kept in multimaps, so the next thread
+
+//	is found in O(log n).
+
+//
+
+//	Real-time threads run ahead of the others, earliest deadline
+
+//	first. Their budget is enforced with the quantum timer, and the
+
+//	start of their jobs is scheduled as a timer interrupt at the
+
+//	earliest end of period.
 
 */
 
@@ -42,6 +72,88 @@
 
 #include "kernel/thread.h"
 
+#include "kernel/process.h"
+
+#include "kernel/synch.h"
+
+#include "utility/config.h"
+
+#include <string.h>
+
+
+
+//----------------------------------------------------------------------
+
+// SchedulerQuantumExpired
+
+/*! 	Timer handler of the end of a quantum. Need this to be a C
+
+//	routine, because C++ can't handle pointers to member functions.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+SchedulerQuantumExpired(int64_t quantum_number)
+
+{
+
+    g_scheduler->QuantumExpired(quantum_number);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// SchedulerReleaseJobs
+
+/*! 	Timer handler of the start of real-time jobs. Need this to be a
+
+//	C routine, because C++ can't handle pointers to member functions.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+SchedulerReleaseJobs(int64_t)
+
+{
+
+    g_scheduler->ReleaseJobs();
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// SchedulerPreemptForRealTime
+
+/*! 	Timer handler of the preemption for a real-time thread woken
+
+//	up. Need this to be a C routine, because C++ can't handle
+
+//	pointers to member functions.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+SchedulerPreemptForRealTime(int64_t)
+
+{
+
+    g_scheduler->PreemptForRealTime();
+
+}
+
 
 
 //----------------------------------------------------------------------
@@ -60,7 +172,61 @@ Scheduler::Scheduler()
 
 {
 
-    readyList = new Listint;
+    for (int i = 0; i < SCHED_NB_LEVELS; i++) {
+
+      readyList[i] = new Listint;
+
+      queue_length[i] = max_queue_length[i] = nb_queued[i] = 0;
+
+      sum_queue_length[i] = 0;
+
+    }
+
+    quantum_number = 0;
+
+    quantum_armed = false;
+
+    quantum_start = 0;
+
+    idle = false;
+
+    preempting = false;
+
+    nb_voluntary = nb_involuntary = 0;
+
+    nb_demotions = nb_boosts = nb_agings = 0;
+
+    policy = (g_cfg->ThreadScheduler == SCHED_POLICY_FAIR) ?
+
+      SCHED_POLICY_FAIR : SCHED_POLICY_MLFQ;
+
+    min_vruntime = 0;
+
+    fair_start = 0;
+
+    fair_queue_length = max_fair_queue_length = 0;
+
+    run_start = 0;
+
+    for (int i = 0; i < SCHED_LATENCY_BUCKETS; i++)
+
+      latency[i] = 0;
+
+    max_latency = sum_latency = 0;
+
+    nb_dispatched = 0;
+
+    rt_utilization = 0;
+
+    release_armed = false;
+
+    release_at = 0;
+
+    rt_preempt_armed = false;
+
+    nb_rt_admitted = nb_rt_refused = 0;
+
+    nb_rt_jobs = nb_rt_misses = nb_rt_overruns = 0;
 
 }
 
@@ -70,7 +236,7 @@ Scheduler::Scheduler()
 
 // Scheduler::~Scheduler
 
-/*! 	Destructor. De-allocate the list of ready threads.
+/*! 	Destructor. De-allocate the lists of ready threads.
 
 */
 
@@ -80,7 +246,9 @@ Scheduler::~Scheduler()
 
 {
 
-    delete readyList;
+    for (int i = 0; i < SCHED_NB_LEVELS; i++)
+
+      delete readyList[i];
 
 }
 
@@ -92,7 +260,17 @@ Scheduler::~Scheduler()
 
 /*! 	Mark a thread as ready, but not necessarily running yet.
 
-//	Put it in the ready list, for later scheduling onto the CPU.
+//	Put it in the ready list of its level, for later scheduling onto
+
+//	the CPU. A thread woken up after blocking moves up one level.
+
+//	Real-time threads are put in their own list, by deadline, and
+
+//	preempt the running thread at the next tick if their deadline is
+
+//	earlier: the wakeup may come from an interrupt handler (end of
+
+//	an I/O), where only a handler may ask for a yield.
 
 //
 
@@ -108,9 +286,119 @@ Scheduler::ReadyToRun (Thread *thread)
 
 {
 
-    DEBUG('t', (char *)"Putting thread %s in ready list.\n", thread->GetName());
+    Time now = g_stats->getTotalTicks();
+
+    if (thread->sched.blocked)
+
+      thread->sched.sleep_ticks += now - thread->sched.sleep_since;
+
+    thread->sched.ready_since = now;
+
+
+
+    if (thread->sched.rt_period > 0) {
+
+      thread->sched.blocked = false;
+
+      if (thread->sched.rt_job_done) {
+
+	// out of budget: wait for the next period
+
+	thread->sched.rt_waiting = true;
+
+	return;
+
+      }
+
+      DEBUG('t', (char *)"Putting thread %s in real-time ready list.\n",
+
+	    thread->GetName());
+
+      thread->sched.rt_ready_pos =
 
-    readyList->Append((void *)thread);
+	rtReady.insert(std::make_pair(thread->sched.rt_deadline, thread));
+
+      thread->sched.rt_queued = true;
+
+      ArmQuantum();
+
+      if (!rt_preempt_armed && (thread != g_current_thread)
+
+	  && RealTimePreempts()) {
+
+	rt_preempt_armed = true;
+
+	g_machine->interrupt->Schedule(SchedulerPreemptForRealTime, 0, 1,
+
+				       TIMER_INT);
+
+      }
+
+      return;
+
+    }
+
+    if (policy == SCHED_POLICY_FAIR) {
+
+      thread->sched.blocked = false;
+
+      FairEnqueue(thread);
+
+      ArmQuantum();
+
+      return;
+
+    }
+
+
+
+    Process *process = thread->GetProcessOwner();
+
+    int base = (process != NULL) ? process->priority : 0;
+
+    if (thread->sched.blocked) {
+
+      thread->sched.blocked = false;
+
+      if (thread->sched.level > base) {
+
+	thread->sched.level--;
+
+	nb_boosts++;
+
+      }
+
+    }
+
+    if (thread->sched.level < base)
+
+      thread->sched.level = base;
+
+    int level = EffectiveLevel(thread);
+
+
+
+    DEBUG('t', (char *)"Putting thread %s in ready list %d.\n",
+
+	  thread->GetName(), level);
+
+    thread->sched.level_since = now;
+
+    readyList[level]->Append((void *)thread);
+
+    queue_length[level]++;
+
+    if (queue_length[level] > max_queue_length[level])
+
+      max_queue_length[level] = queue_length[level];
+
+    sum_queue_length[level] += queue_length[level];
+
+    nb_queued[level]++;
+
+    // the running thread now competes for the CPU
+
+    ArmQuantum();
 
 }
 
@@ -120,9 +408,15 @@ Scheduler::ReadyToRun (Thread *thread)
 
 // Scheduler::FindNextToRun
 
-/*! 	Return the next thread to be scheduled onto the CPU.
+/*! 	Return the next thread to be scheduled onto the CPU: the
+
+//	real-time thread of earliest deadline if any, the first one of
+
+//	the highest non-empty level otherwise, once the threads waiting
 
-//	If there are no ready threads, return NULL.
+//	for too long are moved up. If there are no ready threads, return
+
+//	NULL.
 
 // Side effect:
 
@@ -140,109 +434,129 @@ Scheduler::FindNextToRun ()
 
 {
 
-  Thread * thread=(Thread*)readyList->Remove();
+  if (!rtReady.empty()) {
 
-  return thread;
+    Thread *thread = rtReady.begin()->second;
 
-}
+    rtReady.erase(rtReady.begin());
 
+    thread->sched.rt_queued = false;
 
+    return thread;
 
-//----------------------------------------------------------------------
+  }
 
-// Scheduler::SwitchTo
+  if (policy == SCHED_POLICY_FAIR)
 
-/*! 	Dispatch the CPU to nextThread.  Save the state of the old thread,
+    return FairDequeue();
 
-//	and load the state of the new thread.
+  Age();
 
-//
+  for (int level = 0; level < SCHED_NB_LEVELS; level++) {
 
-//      Note: we assume the state of the previously running thread has
+    if (!readyList[level]->IsEmpty()) {
 
-//	already been changed from running to blocked or ready (depending).
+      queue_length[level]--;
 
-// Side effect:
+      return (Thread*)readyList[level]->Remove();
 
-//	The global variable g_current_thread becomes nextThread.
+    }
 
-//
+  }
+
+  return NULL;
+
+}
 
-//	\param nextThread is the thread to be put into the CPU.
 
-*/
 
 //----------------------------------------------------------------------
 
-void
+// Scheduler::Age
 
-Scheduler::SwitchTo (Thread *nextThread)
+/*! 	Move up one level the first threads of each level that have been
 
-{
+//	waiting for more than SCHED_AGING_TICKS, so that the threads of
 
-Thread *oldThread = g_current_thread;
+//	the lower levels are not starved. The threads of a level are in
 
+//	the order they were filed in, so only the first ones need to be
 
+//	checked. A thread's own level is aged, and the thread is filed
 
-    g_current_thread->CheckOverflow();	 // check if the old thread
+//	again at its effective level, which may still be the one it
 
-				 // had an undetected stack overflow
+//	inherits. The threads already at the base level of their process
 
+//	stay in place, and the ones behind them are still checked.
 
+*/
 
-    DEBUG('t', (char *)"Switching from thread \"%s\" to thread \"%s\" time %llu\n",
+//----------------------------------------------------------------------
 
-	  g_current_thread->GetName(), nextThread->GetName(),g_stats->getTotalTicks());
+void
 
+Scheduler::Age()
 
+{
 
-    // Modify the current thread
+  Time now = g_stats->getTotalTicks();
 
-    g_current_thread = nextThread;
+  for (int level = 1; level < SCHED_NB_LEVELS; level++) {
 
+    std::vector<Thread*> kept;
 
+    while (!readyList[level]->IsEmpty()) {
 
-    // Save the context of old thread
+      Thread *thread = (Thread*)readyList[level]->Remove();
 
-    oldThread->SaveProcessorState();
+      Process *process = thread->GetProcessOwner();
 
-    oldThread->SaveSimulatorState();
+      int base = (process != NULL) ? process->priority : 0;
 
+      if (now - thread->sched.level_since < SCHED_AGING_TICKS) {
 
+	readyList[level]->Prepend((void *)thread);
 
-    // Do the context switch if the two threads are different
+	break;
 
-    if (oldThread!=g_current_thread) {
+      }
 
-    	// Restore the state of the operating system from its
+      if (thread->sched.level <= base) {
 
-    	// kernelContext structure such that it goes on executing when
+	kept.push_back(thread);
 
-    	// it was last interrupted
+	continue;
 
-    	nextThread->RestoreProcessorState();
+      }
 
-	nextThread->RestoreSimulatorState();
+      thread->sched.level--;
 
-    }
+      int new_level = EffectiveLevel(thread);
 
+      DEBUG('t', (char *)"Thread %s aged to level %d, ready list %d\n",
 
+	    thread->GetName(), thread->sched.level, new_level);
 
-    DEBUG('t', (char *)"Now in thread \"%s\" time %llu\n", g_current_thread->GetName(),g_stats->getTotalTicks());
+      queue_length[level]--;
 
+      thread->sched.level_since = now;
 
+      readyList[new_level]->Append((void *)thread);
 
-    // If the old thread gave up the processor because it was finishing,
+      queue_length[new_level]++;
 
-    // we need to delete its carcass.  Note we cannot delete the thread
+      nb_agings++;
 
-    // before now (for example, in Thread::Finish()), because up to this
+    }
 
-    // point, we were still running on the old thread's stack!
+    // put back the threads kept, in their order
 
-  //printf("**** Warning: thread actual deletion not implemented yet\n");
+    for (int i = (int)kept.size() - 1; i >= 0; i--)
 
+      readyList[level]->Prepend((void *)kept[i]);
 
+  }
 
 }
 
@@ -250,11 +564,25 @@ Thread *oldThread = g_current_thread;
 
 //----------------------------------------------------------------------
 
-// Scheduler::Print
+// Scheduler::SwitchTo
 
-/*! 	Print the scheduler state -- in other words, the contents of
+/*! 	Dispatch the CPU to nextThread.  Save the state of the old thread,
 
-//	the ready list.  For debugging.
+//	and load the state of the new thread.
+
+//
+
+//      Note: we assume the state of the previously running thread has
+
+//	already been changed from running to blocked or ready (depending).
+
+// Side effect:
+
+//	The global variable g_current_thread becomes nextThread.
+
+//
+
+//	\param nextThread is the thread to be put into the CPU.
 
 */
 
@@ -262,14 +590,1614 @@ Thread *oldThread = g_current_thread;
 
 void
 
-Scheduler::Print()
+Scheduler::SwitchTo (Thread *nextThread)
 
 {
 
-    printf("Ready list contents: [");
+Thread *oldThread = g_current_thread;
+
+
+
+    g_current_thread->CheckOverflow();	 // check if the old thread
+
+				 // had an undetected stack overflow
+
+
+
+    DEBUG('t', (char *)"Switching from thread \"%s\" to thread \"%s\" time %llu\n",
+
+	  g_current_thread->GetName(), nextThread->GetName(),g_stats->getTotalTicks());
+
+
+
+    // Count the switch, and start the quantum of the new thread
+
+    Charge();
+
+    FairCharge();
+
+    Time now = g_stats->getTotalTicks();
+
+    if (!idle)
+
+      oldThread->sched.run_ticks += now - run_start;
+
+    if (oldThread != nextThread) {
+
+      if (preempting) {
+
+	nb_involuntary++;
+
+	oldThread->sched.nb_involuntary++;
+
+      } else {
+
+	nb_voluntary++;
+
+	oldThread->sched.nb_voluntary++;
+
+      }
+
+    }
+
+
+
+    // Time spent by the new thread in the ready list
+
+    Time wait = now - nextThread->sched.ready_since;
+
+    nextThread->sched.wait_ticks += wait;
+
+    sum_latency += wait;
+
+    if (wait > max_latency)
+
+      max_latency = wait;
+
+    int bucket = 0;
+
+    for (Time limit = 10; (wait >= limit) && (bucket < SCHED_LATENCY_BUCKETS-1);
+
+	 limit *= 10)
+
+      bucket++;
+
+    latency[bucket]++;
+
+    nb_dispatched++;
+
+    run_start = now;
+
+    preempting = false;
+
+    quantum_number++;
+
+    quantum_armed = false;
+
+    quantum_start = g_stats->getTotalTicks();
+
+    fair_start = quantum_start;
+
+
+
+    // Modify the current thread
+
+    g_current_thread = nextThread;
+
+    if (!NoneReady() || (nextThread->sched.rt_period > 0))
+
+      ArmQuantum();
+
+
+
+    // Save the context of old thread
+
+    oldThread->SaveProcessorState();
+
+
+
+    // Do the context switch if the two threads are different
+
+    if (oldThread!=g_current_thread) {
+
+    	// Restore the state of the operating system from its
+
+    	// kernelContext structure such that it goes on executing when
+
+    	// it was last interrupted. SwitchSimulatorState returns once
+
+    	// another thread switches back to the old one.
+
+    	nextThread->RestoreProcessorState();
+
+	oldThread->SwitchSimulatorState(nextThread);
+
+    }
+
+
+
+    DEBUG('t', (char *)"Now in thread \"%s\" time %llu\n", g_current_thread->GetName(),g_stats->getTotalTicks());
+
+
+
+    // If the old thread gave up the processor because it was finishing,
+
+    // we need to delete its carcass.  Note we cannot delete the thread
+
+    // before now (for example, in Thread::Finish()), because up to this
+
+    // point, we were still running on the old thread's stack!
+
+  //printf("**** Warning: thread actual deletion not implemented yet\n");
+
+
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::Print
+
+/*! 	Print the scheduler state -- in other words, the contents of
+
+//	the ready list.  For debugging.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::Print()
+
+{
+
+    for (int i = 0; i < SCHED_NB_LEVELS; i++) {
+
+      printf("Ready list %d contents: [", i);
+
+      readyList[i]->Mapcar((VoidFunctionPtr) ThreadPrint);
+
+      printf("]\n");
+
+    }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::QuantumExpired
+
+/*! 	End of a quantum, at interrupt time. If the thread that got this
+
+//	quantum is still running and another thread is ready, it is
+
+//	preempted, and moves down one level: it yields once the interrupt
+
+//	handler returns. Otherwise, the end of the quantum is scheduled
+
+//	again when a thread becomes ready.
+
+//
+
+//	For a real-time thread, this is the end of its budget: its job
+
+//	is stopped until its next period (it is not put back in the ready
+
+//	list, see ReadyToRun), unless no other thread is ready.
+
+//
+
+//	\param number is the number of the quantum that expired
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::QuantumExpired(int64_t number)
+
+{
+
+    if (number != quantum_number)
+
+      return;			// the thread already gave up the CPU
+
+    quantum_armed = false;
+
+    if (idle)
+
+      return;
+
+    if (g_current_thread->sched.rt_period > 0) {
+
+      Charge();
+
+      if (g_current_thread->sched.rt_remaining > 0) {
+
+	ArmQuantum();
+
+	return;
+
+      }
+
+      if (!g_current_thread->sched.rt_job_done) {
+
+	DEBUG('t', (char *)"Thread \"%s\" is out of budget\n",
+
+	      g_current_thread->GetName());
+
+	g_current_thread->sched.rt_job_done = true;
+
+	g_current_thread->sched.rt_overruns++;
+
+	nb_rt_overruns++;
+
+      }
+
+      // it keeps the CPU only while no other thread is ready
+
+      if (NoneReady())
+
+	return;
+
+      preempting = true;
+
+      g_machine->interrupt->YieldOnReturn();
+
+      return;
+
+    }
+
+    if (NoneReady())
+
+      return;
+
+    DEBUG('t', (char *)"Quantum of thread \"%s\" expired\n",
+
+	  g_current_thread->GetName());
+
+    if ((policy == SCHED_POLICY_MLFQ)
+
+	&& (g_current_thread->sched.level < SCHED_NB_LEVELS - 1)) {
+
+      g_current_thread->sched.level++;
+
+      nb_demotions++;
+
+    }
+
+    preempting = true;
+
+    g_machine->interrupt->YieldOnReturn();
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::ArmQuantum
+
+/*! 	Schedule the end of the quantum of the running thread, if
+
+//	preemption is enabled and it is not already scheduled.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::ArmQuantum()
+
+{
+
+    if (quantum_armed || (g_current_thread == NULL))
+
+      return;
+
+    int quantum = GetQuantum(g_current_thread);
+
+    if (quantum <= 0)
+
+      return;
+
+    quantum_armed = true;
+
+    Time now = g_stats->getTotalTicks();
+
+    Time end = quantum_start + quantum;
+
+    int when = (end > now) ? (int)(end - now) : 1;
+
+    g_machine->interrupt->Schedule(SchedulerQuantumExpired, quantum_number,
+
+				   when, TIMER_INT);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::GetQuantum
+
+/*! 	Return the time quantum of a thread: the one of its process if
+
+//	set, TimeQuantum in the configuration otherwise, doubled at each
+
+//	level below the highest one (MLFQ policy). The quantum of a
+
+//	real-time thread is the budget left to its job.
+
+//
+
+//	\return the quantum in ticks, 0 if the thread is not preempted
+
+*/
+
+//----------------------------------------------------------------------
+
+int
+
+Scheduler::GetQuantum(Thread *thread)
+
+{
+
+    if (thread->sched.rt_period > 0)
+
+      return (thread->sched.rt_remaining > 0)
+
+	? (int)thread->sched.rt_remaining : 1;
+
+    Process *process = thread->GetProcessOwner();
+
+    int quantum = g_cfg->TimeQuantum;
+
+    if ((process != NULL) && (process->quantum > 0))
+
+      quantum = process->quantum;
+
+    if (policy == SCHED_POLICY_FAIR)
+
+      return quantum;
+
+    return quantum << thread->sched.level;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::NoneReady
+
+/*! 	\return true if no thread is ready to run
+
+*/
+
+//----------------------------------------------------------------------
+
+bool
+
+Scheduler::NoneReady()
+
+{
+
+    if (!rtReady.empty() || !fairProcesses.empty())
+
+      return false;
+
+    for (int i = 0; i < SCHED_NB_LEVELS; i++)
+
+      if (!readyList[i]->IsEmpty())
+
+	return false;
+
+    return true;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::SetIdle
+
+/*! 	Tell whether the CPU is idle, waiting for an interrupt. The
+
+//	idle time is not charged to the budget of a real-time thread, nor
+
+//	to the virtual run time of a thread.
+
+//
+
+//	\param is_idle is true when the CPU starts waiting
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::SetIdle(bool is_idle)
+
+{
+
+    Time now = g_stats->getTotalTicks();
+
+    if (is_idle && !idle) {
+
+      Charge();
+
+      FairCharge();
+
+      g_current_thread->sched.run_ticks += now - run_start;
+
+    }
+
+    // the time charged restarts only when the CPU was really idle:
+
+    // Thread::Sleep calls SetIdle(false) after every sleep
+
+    if (!is_idle && idle)
+
+      quantum_start = fair_start = run_start = now;
+
+    idle = is_idle;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::CheckPreemption
+
+/*! 	Interrupt::Idle runs the pending interrupt handlers and forgets
+
+//	their YieldOnReturn. A thread that busy waits with Idle (polling
+
+//	drivers) calls this after each wait, so that the end of its
+
+//	quantum, or the release of a real-time job, still preempts it.
+
+//	Interrupts must be disabled.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::CheckPreemption()
+
+{
+
+    if (!preempting)
+
+      return;
+
+    g_current_thread->Yield();
+
+    // nobody else was ready, or we run again: the request is served
+
+    preempting = false;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::EffectiveLevel
+
+/*! 	Return the level a thread is scheduled at: its own level in the
+
+//	multi-level feedback queue, or the level it inherits from the
+
+//	waiters of the locks it holds if higher. The real-time threads
+
+//	are above all the levels.
+
+//
+
+//	\param thread is the thread
+
+//	\return the effective level (0: highest)
+
+*/
+
+//----------------------------------------------------------------------
+
+int
+
+Scheduler::EffectiveLevel(Thread *thread)
+
+{
+
+    if (thread->sched.rt_period > 0)
+
+      return 0;
+
+    if (thread->sched.inherited < thread->sched.level)
+
+      return thread->sched.inherited;
+
+    return thread->sched.level;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::SetInheritedLevel
+
+/*! 	Change the level a thread inherits from the waiters of the locks
+
+//	it holds. If the thread is in a ready list and its effective
+
+//	level changes, it is moved to the list of its new level.
+
+//
+
+//	\param thread is the thread
+
+//	\param level is the inherited level (SCHED_NB_LEVELS: none)
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::SetInheritedLevel(Thread *thread, int level)
+
+{
+
+    int old_level = EffectiveLevel(thread);
+
+    thread->sched.inherited = level;
+
+    int new_level = EffectiveLevel(thread);
+
+    if ((new_level == old_level) || (policy != SCHED_POLICY_MLFQ)
+
+	|| (thread->sched.rt_period > 0))
+
+      return;
+
+    if (!readyList[old_level]->Search((void *)thread))
+
+      return;			// running or blocked
+
+    DEBUG('t', (char *)"Thread %s moved from ready list %d to %d\n",
+
+	  thread->GetName(), old_level, new_level);
+
+    readyList[old_level]->RemoveItem((void *)thread);
+
+    queue_length[old_level]--;
+
+    // the lists are in level_since order, which Age relies on
+
+    thread->sched.level_since = g_stats->getTotalTicks();
+
+    readyList[new_level]->Append((void *)thread);
+
+    queue_length[new_level]++;
+
+    if (queue_length[new_level] > max_queue_length[new_level])
+
+      max_queue_length[new_level] = queue_length[new_level];
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::ThreadFinished
+
+/*! 	Add the scheduling counters of a finishing thread to the ones of
+
+//	its process.
+
+//
+
+//	\param thread is the running thread, which is finishing
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::ThreadFinished(Thread *thread)
+
+{
+
+    Time now = g_stats->getTotalTicks();
+
+    thread->sched.run_ticks += now - run_start;
+
+    run_start = now;
+
+    DEBUG('t', (char *)"Thread \"%s\": run %llu, ready %llu, sleep %llu "
+
+	  "ticks\n", thread->GetName(), thread->sched.run_ticks,
+
+	  thread->sched.wait_ticks, thread->sched.sleep_ticks);
+
+
+
+    SchedCounters &c = ProcessCounters(thread);
+
+    c.nb_threads++;
+
+    c.run_ticks += thread->sched.run_ticks;
+
+    c.wait_ticks += thread->sched.wait_ticks;
+
+    c.sleep_ticks += thread->sched.sleep_ticks;
+
+    // the switch away from the finishing thread is voluntary
+
+    c.nb_voluntary += thread->sched.nb_voluntary + 1;
+
+    c.nb_involuntary += thread->sched.nb_involuntary;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::ThreadAlive
+
+/*! 	Add the scheduling counters of a thread still alive when Nachos
+
+//	stops to the ones of its process, including the time spent in its
+
+//	current state.
+
+//
+
+//	\param thread is a thread of g_alive
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::ThreadAlive(Thread *thread)
+
+{
+
+    Time now = g_stats->getTotalTicks();
+
+    SchedCounters &c = ProcessCounters(thread);
+
+    c.nb_alive++;
+
+    c.run_ticks += thread->sched.run_ticks;
+
+    c.wait_ticks += thread->sched.wait_ticks;
+
+    c.sleep_ticks += thread->sched.sleep_ticks;
+
+    if (thread == g_current_thread) {
+
+      if (!idle)
+
+	c.run_ticks += now - run_start;
+
+    } else if (thread->sched.blocked)
+
+      c.sleep_ticks += now - thread->sched.sleep_since;
+
+    else
+
+      c.wait_ticks += now - thread->sched.ready_since;
+
+    c.nb_voluntary += thread->sched.nb_voluntary;
+
+    c.nb_involuntary += thread->sched.nb_involuntary;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// SchedulerThreadAlive
+
+/*! 	Add the counters of a thread alive at the end, for Mapcar. Need
+
+//	this to be a C routine, because C++ can't handle pointers to
+
+//	member functions.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+SchedulerThreadAlive(int64_t arg)
+
+{
+
+    g_scheduler->ThreadAlive((Thread *)arg);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::ProcessCounters
+
+/*! 	Return the scheduling counters of the process of a thread. The
+
+//	processes are told apart by their statistics object, so that two
+
+//	processes running the same program are not merged.
+
+//
+
+//	\param thread is the thread
+
+*/
+
+//----------------------------------------------------------------------
+
+SchedCounters &
+
+Scheduler::ProcessCounters(Thread *thread)
+
+{
+
+    Process *process = thread->GetProcessOwner();
+
+    ProcessStat *stat = (process != NULL) ? process->stat : NULL;
+
+    std::map<ProcessStat*,int>::iterator it = process_index.find(stat);
+
+    if (it != process_index.end())
+
+      return by_process[it->second];
+
+    SchedCounters c;
+
+    c.name = (process != NULL) ? process->getName() : "?";
+
+    c.nb_threads = c.nb_alive = 0;
+
+    c.run_ticks = c.wait_ticks = c.sleep_ticks = 0;
+
+    c.nb_voluntary = c.nb_involuntary = 0;
+
+    process_index[stat] = (int)by_process.size();
+
+    by_process.push_back(c);
+
+    return by_process.back();
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::FairCharge
+
+/*! 	Charge the CPU time used since the last charge to the virtual
+
+//	run time of the running thread, and to the one of its process,
+
+//	divided by the weight of the process (Fair policy).
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::FairCharge()
+
+{
+
+    Thread *thread = g_current_thread;
+
+    Time now = g_stats->getTotalTicks();
+
+    int64_t ran = (int64_t)(now - fair_start);
+
+    fair_start = now;
+
+    if ((policy != SCHED_POLICY_FAIR) || (thread == NULL)
+
+	|| (thread->sched.rt_period > 0) || idle)
+
+      return;
+
+    thread->sched.vruntime += ran;
+
+    Process *process = thread->GetProcessOwner();
+
+    if (process == NULL)
+
+      return;
+
+    // keep the remainder, or short runs of heavy processes would
+
+    // never be charged
+
+    int64_t scaled = ran * SCHED_DEFAULT_WEIGHT + process->vruntime_rest;
+
+    int64_t delta = scaled / process->weight;
+
+    process->vruntime_rest = scaled % process->weight;
+
+    if (process->fair_ready.empty()) {
+
+      process->vruntime += delta;
+
+    } else {
+
+      // the process is in the ready list: move it at its new place
+
+      fairProcesses.erase(process->fair_pos);
+
+      process->vruntime += delta;
+
+      process->fair_pos =
+
+	fairProcesses.insert(std::make_pair(process->vruntime, process));
+
+    }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::FairEnqueue
+
+/*! 	Put a thread in the ready list of its process, and the process
+
+//	in the ready list of the processes if it is not already in. A
+
+//	thread or process that did not run for a while starts from the
+
+//	least virtual run time of the ready ones, so that it does not
+
+//	get a burst of CPU for the time it was blocked.
+
+//
+
+//	\param thread is the thread to be put on the ready list.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::FairEnqueue(Thread *thread)
+
+{
+
+    Process *process = thread->GetProcessOwner();
+
+    ASSERT(process != NULL);
+
+    if (thread == g_current_thread)
+
+      FairCharge();		// the thread yields
+
+    DEBUG('t', (char *)"Putting thread %s in the ready list of %s.\n",
+
+	  thread->GetName(), process->getName());
+
+    if (process->fair_ready.empty()) {
+
+      if (process->vruntime < min_vruntime)
+
+	process->vruntime = min_vruntime;
+
+      process->fair_pos =
+
+	fairProcesses.insert(std::make_pair(process->vruntime, process));
+
+    }
+
+    if (thread->sched.vruntime < process->min_vruntime)
+
+      thread->sched.vruntime = process->min_vruntime;
+
+    process->fair_ready.insert(std::make_pair(thread->sched.vruntime, thread));
+
+    fair_queue_length++;
+
+    if (fair_queue_length > max_fair_queue_length)
+
+      max_fair_queue_length = fair_queue_length;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::FairDequeue
+
+/*! 	Remove the next thread to run: the thread of least virtual run
+
+//	time of the process of least virtual run time (Fair policy).
+
+//
+
+//	\return the thread, NULL if no thread is ready
+
+*/
+
+//----------------------------------------------------------------------
+
+Thread *
+
+Scheduler::FairDequeue()
+
+{
+
+    if (fairProcesses.empty())
+
+      return NULL;
+
+    Process *process = fairProcesses.begin()->second;
+
+    if (process->vruntime > min_vruntime)
+
+      min_vruntime = process->vruntime;
+
+    Thread *thread = process->fair_ready.begin()->second;
+
+    if (thread->sched.vruntime > process->min_vruntime)
+
+      process->min_vruntime = thread->sched.vruntime;
+
+    process->fair_ready.erase(process->fair_ready.begin());
+
+    if (process->fair_ready.empty())
+
+      fairProcesses.erase(process->fair_pos);
+
+    fair_queue_length--;
+
+    return thread;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::DefaultWeight
+
+/*! 	Return the initial weight of a process: the one given to its
+
+//	program in the configuration (ProcessWeight), or
+
+//	SCHED_DEFAULT_WEIGHT.
+
+//
+
+//	\param program is the name of the executable file
+
+*/
+
+//----------------------------------------------------------------------
+
+int
+
+Scheduler::DefaultWeight(char *program)
+
+{
+
+    for (int i = 0; i < g_cfg->NbProcessWeights; i++)
+
+      if (strcmp(g_cfg->ProcessWeightName[i], program) == 0)
+
+	return g_cfg->ProcessWeightValue[i];
+
+    return SCHED_DEFAULT_WEIGHT;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::Charge
+
+/*! 	Charge the CPU time used since the last charge, or the start of
+
+//	its quantum, to the budget of the running real-time thread.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::Charge()
+
+{
+
+    Thread *thread = g_current_thread;
+
+    if ((thread == NULL) || (thread->sched.rt_period == 0) || idle)
+
+      return;
+
+    Time now = g_stats->getTotalTicks();
+
+    thread->sched.rt_remaining -= (int64_t)(now - quantum_start);
+
+    quantum_start = now;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::SetRealTime
+
+/*! 	Move a thread in or out of the real-time class. The thread is
+
+//	admitted only if the total utilization of the class stays under
+
+//	100%. Its first job starts at once.
+
+//
+
+//	\param thread is the running thread, or a finishing one
+
+//	\param period is the period in ticks, 0 to leave the class
+
+//	\param budget is the CPU time of each job, at most the period
+
+//	\return false if the thread was refused by the admission control
+
+*/
+
+//----------------------------------------------------------------------
+
+bool
+
+Scheduler::SetRealTime(Thread *thread, int period, int budget)
+
+{
+
+    schedStateT *s = &thread->sched;
+
+    int old_util = (s->rt_period > 0)
+
+      ? (int)((int64_t)s->rt_budget * SCHED_RT_MAX_UTILIZATION / s->rt_period)
+
+      : 0;
+
+    int new_util = (period > 0)
+
+      ? (int)((int64_t)budget * SCHED_RT_MAX_UTILIZATION / period) : 0;
+
+    if (rt_utilization - old_util + new_util > SCHED_RT_MAX_UTILIZATION) {
+
+      DEBUG('t', (char *)"Thread \"%s\" refused in the real-time class\n",
+
+	    thread->GetName());
+
+      nb_rt_refused++;
+
+      return false;
+
+    }
+
+
+
+    // Leave the real-time class
+
+    if (s->rt_period > 0) {
+
+      rt_utilization -= old_util;
+
+      rtReleases.erase(s->rt_release_pos);
+
+      bool ready = s->rt_queued || s->rt_waiting;
+
+      if (s->rt_queued)
+
+	rtReady.erase(s->rt_ready_pos);
+
+      if (g_cfg->PrintStat)
+
+	printf("Thread %s: real-time period %d, budget %d: %d jobs, "
+
+	       "%d deadline misses, %d budget overruns\n", thread->GetName(),
+
+	       s->rt_period, s->rt_budget, s->rt_nb_jobs, s->rt_misses,
+
+	       s->rt_overruns);
+
+      s->rt_period = 0;
+
+      s->rt_budget = 0;
+
+      s->rt_queued = false;
+
+      s->rt_waiting = false;
+
+      if (ready)
+
+	ReadyToRun(thread);
+
+    }
+
+    if (period == 0)
+
+      return true;
+
+
+
+    // Enter the real-time class, and start the first job
+
+    Time now = g_stats->getTotalTicks();
+
+    rt_utilization += new_util;
+
+    s->rt_period = period;
+
+    s->rt_budget = budget;
+
+    s->rt_deadline = now + period;
+
+    s->rt_remaining = budget;
+
+    s->rt_job_done = false;
+
+    s->rt_nb_jobs = 1;
+
+    s->rt_misses = s->rt_overruns = 0;
+
+    s->rt_release_pos =
+
+      rtReleases.insert(std::make_pair(s->rt_deadline, thread));
+
+    nb_rt_admitted++;
+
+    nb_rt_jobs++;
+
+    if (thread == g_current_thread) {
+
+      // the budget replaces the quantum
+
+      quantum_number++;
+
+      quantum_armed = false;
+
+      quantum_start = now;
+
+      ArmQuantum();
+
+    }
+
+    ArmRelease();
+
+    return true;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::EndOfJob
+
+/*! 	Called by the Yield system call. A real-time thread that yields
+
+//	completes its job: it then waits for its next period. The
+
+//	internal yields of the kernel (retry loops) do not end a job.
+
+//
+
+//	\param thread is the yielding thread
+
+//	\return true if the thread must sleep until its next period
+
+*/
+
+//----------------------------------------------------------------------
+
+bool
+
+Scheduler::EndOfJob(Thread *thread)
+
+{
+
+    if (thread->sched.rt_period == 0)
+
+      return false;
+
+    Charge();
+
+    thread->sched.rt_job_done = true;
+
+    thread->sched.rt_waiting = true;
+
+    return true;
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::ReleaseJobs
+
+/*! 	Start the new jobs of the real-time threads whose period is
+
+//	over, at interrupt time. A job that is not complete at the end of
+
+//	its period missed its deadline. The threads waiting for their
+
+//	period become ready, and preempt the running thread if their
+
+//	deadline is earlier.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::ReleaseJobs()
+
+{
+
+    Time now = g_stats->getTotalTicks();
+
+    if (release_armed && (now >= release_at))
+
+      release_armed = false;
+
+
+
+    while (!rtReleases.empty() && (rtReleases.begin()->first <= now)) {
+
+      Thread *thread = rtReleases.begin()->second;
+
+      schedStateT *s = &thread->sched;
+
+      rtReleases.erase(rtReleases.begin());
+
+      if (!s->rt_job_done) {
+
+	DEBUG('t', (char *)"Thread \"%s\" missed its deadline\n",
+
+	      thread->GetName());
+
+	s->rt_misses++;
+
+	nb_rt_misses++;
+
+      }
+
+      if (thread == g_current_thread)
+
+	Charge();
+
+
+
+      // Start the next job
+
+      s->rt_deadline += s->rt_period;
+
+      s->rt_remaining = s->rt_budget;
+
+      s->rt_job_done = false;
+
+      s->rt_nb_jobs++;
+
+      nb_rt_jobs++;
+
+      s->rt_release_pos =
+
+	rtReleases.insert(std::make_pair(s->rt_deadline, thread));
+
+      if (s->rt_queued) {
+
+	rtReady.erase(s->rt_ready_pos);
+
+	s->rt_ready_pos = rtReady.insert(std::make_pair(s->rt_deadline, thread));
+
+      }
+
+      if (s->rt_waiting) {
+
+	s->rt_waiting = false;
+
+	ReadyToRun(thread);
+
+      }
+
+      if ((thread == g_current_thread) && !idle) {
+
+	// the new budget replaces the one of the previous job
+
+	quantum_number++;
+
+	quantum_armed = false;
+
+	ArmQuantum();
+
+      }
+
+    }
+
+    ArmRelease();
+
+
+
+    if (RealTimePreempts()) {
+
+      preempting = true;
+
+      g_machine->interrupt->YieldOnReturn();
+
+    }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::PreemptForRealTime
+
+/*! 	Timer handler scheduled by ReadyToRun when a real-time thread
+
+//	becomes ready: the running thread is preempted if the thread
+
+//	is still the first one and its deadline is earlier.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::PreemptForRealTime()
+
+{
+
+    rt_preempt_armed = false;
+
+    if (RealTimePreempts()) {
+
+      DEBUG('t', (char *)"Thread \"%s\" preempted by a real-time thread\n",
+
+	    g_current_thread->GetName());
+
+      preempting = true;
+
+      g_machine->interrupt->YieldOnReturn();
+
+    }
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::RealTimePreempts
+
+/*! 	\return true if the CPU runs a thread, and the real-time thread
+
+//	of earliest deadline must preempt it: it is not real-time, or
+
+//	its deadline is later
+
+*/
+
+//----------------------------------------------------------------------
+
+bool
+
+Scheduler::RealTimePreempts()
+
+{
+
+    return !idle && (g_current_thread != NULL) && !rtReady.empty()
+
+      && ((g_current_thread->sched.rt_period == 0)
+
+	  || (rtReady.begin()->first < g_current_thread->sched.rt_deadline));
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::ArmRelease
+
+/*! 	Schedule the start of the next real-time job, unless an earlier
+
+//	release is already scheduled.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::ArmRelease()
+
+{
+
+    if (rtReleases.empty())
+
+      return;
+
+    Time next = rtReleases.begin()->first;
+
+    if (release_armed && (release_at <= next))
+
+      return;
+
+    Time now = g_stats->getTotalTicks();
+
+    release_armed = true;
+
+    release_at = next;
+
+    int when = (next > now) ? (int)(next - now) : 1;
+
+    g_machine->interrupt->Schedule(SchedulerReleaseJobs, 0, when, TIMER_INT);
+
+}
+
+
+
+//----------------------------------------------------------------------
+
+// Scheduler::PrintStat
+
+/*! 	Print the scheduling statistics: the context switches, voluntary
+
+//	(Yield, Sleep, Finish) or involuntary (end of quantum), the time
+
+//	spent in the ready list, the time spent running, ready and
+
+//	sleeping by the threads of each process, the moves between levels
+
+//	and the length of the queue of each level.
+
+*/
+
+//----------------------------------------------------------------------
+
+void
+
+Scheduler::PrintStat()
+
+{
+
+    printf("Scheduler: quantum %d ticks, %d voluntary switches, "
+
+	   "%d involuntary switches\n",
+
+	   g_cfg->TimeQuantum, nb_voluntary, nb_involuntary);
+
+    printf("Scheduler: floating point registers switched %d times, "
+
+	   "%d switches without\n", Thread::nb_fp_switches,
+
+	   Thread::nb_fp_skipped);
+
+    printf("Scheduler: %d priority inversions on locks, %d priorities "
+
+	   "inherited, longest chain of locks %d\n", Lock::nb_inversions,
+
+	   Lock::nb_inheritances, Lock::max_chain);
+
+    printf("Scheduler: %d dispatches, run-queue latency mean %.1f, "
+
+	   "max %llu ticks\n", nb_dispatched,
+
+	   nb_dispatched ? (double)sum_latency / nb_dispatched : 0.0,
+
+	   (unsigned long long)max_latency);
+
+    printf("Scheduler: run-queue latency histogram:");
+
+    Time limit = 10;
+
+    for (int i = 0; i < SCHED_LATENCY_BUCKETS - 1; i++, limit *= 10)
+
+      printf(" <%llu: %llu", (unsigned long long)limit,
+
+	     (unsigned long long)latency[i]);
+
+    printf(" more: %llu\n",
+
+	   (unsigned long long)latency[SCHED_LATENCY_BUCKETS - 1]);
+
+    g_alive->Mapcar((VoidFunctionPtr) SchedulerThreadAlive);
+
+    for (unsigned int i = 0; i < by_process.size(); i++) {
+
+      SchedCounters &c = by_process[i];
+
+      printf("Scheduler: process %s: %d threads finished, %d alive, "
+
+	     "%llu ticks running, %llu ready, %llu sleeping, %d voluntary "
+
+	     "and %d involuntary switches\n", c.name.c_str(), c.nb_threads,
+
+	     c.nb_alive,
+
+	     (unsigned long long)c.run_ticks, (unsigned long long)c.wait_ticks,
+
+	     (unsigned long long)c.sleep_ticks, c.nb_voluntary,
+
+	     c.nb_involuntary);
+
+    }
+
+    printf("Scheduler: real-time class: %d threads admitted, %d refused, "
+
+	   "%d jobs, %d deadline misses, %d budget overruns\n",
+
+	   nb_rt_admitted, nb_rt_refused, nb_rt_jobs, nb_rt_misses,
+
+	   nb_rt_overruns);
+
+    if (policy == SCHED_POLICY_FAIR) {
+
+      printf("Scheduler: fair share by process weight, max %d threads "
+
+	     "ready\n", max_fair_queue_length);
+
+      return;
+
+    }
+
+    printf("Scheduler: %d demotions, %d boosts after blocking, %d agings\n",
+
+	   nb_demotions, nb_boosts, nb_agings);
+
+    for (int i = 0; i < SCHED_NB_LEVELS; i++)
+
+      printf("Scheduler level %d: %d threads queued, mean queue length %.2f, "
+
+	     "max %d\n", i, nb_queued[i],
 
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+	     nb_queued[i] ? (double)sum_queue_length[i] / nb_queued[i] : 0.0,
 
-    printf("]\n");
+	     max_queue_length[i]);
 
 }
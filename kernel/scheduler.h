@@ -14,6 +14,62 @@
 
 
 
+   Ready threads are kept in a multi-level feedback queue: the
+
+   threads of the highest non-empty level run first, round robin.
+
+   A thread that uses its whole quantum moves down one level, where
+
+   the quantum is twice longer; a thread that blocked moves up one
+
+   level when it is woken up; a thread waiting too long in its level
+
+   moves up one level (aging). Threads never go above the base
+
+   priority of their process.
+
+
+
+   With the Fair policy, the multi-level feedback queue is replaced by
+
+   a proportional share of the CPU between the processes, according to
+
+   their weight, each share being divided evenly between the threads
+
+   of the process. Processes and threads are kept ordered by virtual
+
+   run time (CPU time used, divided by the weight for processes), the
+
+   one that used the least running first.
+
+
+
+   Periodic real-time threads form a class of their own, scheduled
+
+   ahead of the others by earliest deadline first (EDF). Such a thread
+
+   runs a job every period, for at most its budget, and must complete
+
+   it (by calling Yield) before the end of the period, which is its
+
+   deadline. A thread is only admitted in this class if the total
+
+   utilization (budget/period) of the class stays under 100%.
+
+
+
+   A thread holding a lock inherits the level of the highest waiter
+
+   of the lock (priority inheritance, see Lock): its effective level
+
+   is the highest of its own level and of the inherited one, and it
+
+   is queued at that level. Inheritance has no effect on the order of
+
+   the threads under the Fair policy.
+
+
+
    Copyright (c) 1992-1993 The Regents of the University of California.
 
    All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -36,12 +92,92 @@
 
 #include "kernel/copyright.h"
 
+#include <map>
+
+#include <string>
+
+#include <vector>
+
 #include "utility/list.h"
 
+#include "utility/stats.h"
+
 
 
 class Thread;
 
+class Process;
+
+
+
+/*! Scheduling policies of the threads that are not real-time */
+
+enum SchedPolicy {
+
+  SCHED_POLICY_MLFQ = 0,   //!< Multi-level feedback queue
+
+  SCHED_POLICY_FAIR        //!< Proportional share by process weight
+
+};
+
+
+
+//! Weight of a process by default (Fair policy)
+
+#define SCHED_DEFAULT_WEIGHT 1024
+
+
+
+//! Number of levels of the multi-level feedback queue (0: highest)
+
+#define SCHED_NB_LEVELS 4
+
+
+
+//! Ticks after which a ready thread moves up one level
+
+#define SCHED_AGING_TICKS 200000
+
+
+
+//! Number of buckets of the run-queue latency histogram: bucket i
+
+//! counts the waits of less than 10^i ticks, the last one the others
+
+#define SCHED_LATENCY_BUCKETS 7
+
+
+
+/*! \brief Scheduling counters of the threads of a process */
+
+typedef struct {
+
+  std::string name;           //!< Name of the process
+
+  int nb_threads;             //!< Number of threads finished
+
+  int nb_alive;               //!< Number of threads alive at the end
+
+  Time run_ticks;             //!< Time spent running
+
+  Time wait_ticks;            //!< Time spent in the ready list
+
+  Time sleep_ticks;           //!< Time spent sleeping (blocked)
+
+  int nb_voluntary;           //!< Switches on Yield, Sleep or Finish
+
+  int nb_involuntary;         //!< Switches on preemption
+
+} SchedCounters;
+
+
+
+//! Utilization of the real-time threads accepted by the admission
+
+//! control, in millionths of the CPU
+
+#define SCHED_RT_MAX_UTILIZATION 1000000
+
 
 
 class Scheduler {
@@ -86,15 +222,311 @@ public:
 
 
 
+  //! Timer handler: the quantum of the running thread is over
+
+  void QuantumExpired(int64_t quantum_number);
+
+
+
+  //! Tell whether the CPU is idle, waiting for an interrupt
+
+  void SetIdle(bool is_idle);
+
+
+
+  //! Give up the CPU if an interrupt handler run by Interrupt::Idle
+
+  //! asked for a preemption (busy waits of the drivers)
+
+  void CheckPreemption();
+
+
+
+  //! Move a thread in or out of the real-time class
+
+  bool SetRealTime(Thread *thread, int period, int budget);
+
+
+
+  //! Tell whether a yielding thread must wait for its next period
+
+  bool EndOfJob(Thread *thread);
+
+
+
+  //! Timer handler: start the new jobs of the real-time threads
+
+  void ReleaseJobs();
+
+
+
+  //! Timer handler: preempt the running thread for a real-time
+
+  //! thread woken up
+
+  void PreemptForRealTime();
+
+
+
+  //! Add the counters of a finishing thread to its process
+
+  void ThreadFinished(Thread *thread);
+
+
+
+  //! Add the counters of a thread still alive at the end to its
+
+  //! process
+
+  void ThreadAlive(Thread *thread);
+
+
+
+  //! Effective level of a thread, inheritance included (0 for the
+
+  //! real-time threads)
+
+  int EffectiveLevel(Thread *thread);
+
+
+
+  //! Change the level a thread inherits from the waiters of its locks
+
+  void SetInheritedLevel(Thread *thread, int level);
+
+
+
+  //! Initial weight of a process, from the configuration
+
+  static int DefaultWeight(char *program);
+
+
+
+  //! Print the scheduling statistics
+
+  void PrintStat();
+
+
+
 protected:  
 
-  //! Queue of threads that are ready to run, but not running.
+  //! Queues of threads that are ready to run, but not running,
+
+  //! one per level
+
+  Listint *readyList[SCHED_NB_LEVELS];
+
+
+
+  //! Move up the threads waiting for too long in their level
+
+  void Age();
+
+
+
+  //! Schedule the end of the quantum of the running thread
+
+  void ArmQuantum();
+
+
+
+  //! Time quantum of a thread at its level, in ticks (0: no preemption)
+
+  int GetQuantum(Thread *thread);
+
+
+
+  //! Return true if no thread is ready
+
+  bool NoneReady();
+
+
+
+  //! Charge the CPU time used by the running real-time thread
+
+  void Charge();
+
+
+
+  //! Schedule the next release of a real-time job
+
+  void ArmRelease();
+
+
+
+  //! Return true if the first ready real-time thread must preempt
+
+  //! the running thread
+
+  bool RealTimePreempts();
+
+
+
+  //! Charge the CPU time used to the virtual run time of the running
+
+  //! thread and of its process (Fair policy)
+
+  void FairCharge();
+
+
+
+  //! Put a thread in the ready list of its process (Fair policy)
+
+  void FairEnqueue(Thread *thread);
+
+
+
+  //! Remove the next thread to run (Fair policy)
+
+  Thread *FairDequeue();
+
+
+
+  SchedPolicy policy;         //!< Policy of the threads not real-time
+
+
+
+  //! Processes with threads ready to run, by virtual run time (Fair
+
+  //! policy)
+
+  std::multimap<int64_t,Process*> fairProcesses;
+
+
+
+  int64_t min_vruntime;       //!< Virtual run time of the processes
+
+                              //!< that become ready (Fair policy)
+
+  Time fair_start;            //!< Start of the time not charged yet
+
+  int fair_queue_length;      //!< Threads ready (Fair policy)
+
+  int max_fair_queue_length;  //!< Maximum of fair_queue_length
+
+
+
+  Time run_start;             //!< Tick the running thread started to run
+
+  int64_t latency[SCHED_LATENCY_BUCKETS]; //!< Run-queue latency histogram
+
+  Time max_latency;           //!< Longest wait in the ready list
 
-  Listint *readyList;
+  Time sum_latency;           //!< Sum of the waits in the ready list
+
+  int nb_dispatched;          //!< Number of threads taken from the
+
+                              //!< ready list
+
+
+
+  //! Scheduling counters of the threads, per process, in the order
+
+  //! the processes were first counted
+
+  std::vector<SchedCounters> by_process;
+
+
+
+  //! Index in by_process of each process, by its statistics object
+
+  //! (which, unlike the process, is never deleted)
+
+  std::map<ProcessStat*,int> process_index;
+
+
+
+  //! Counters of the process of a thread
+
+  SchedCounters &ProcessCounters(Thread *thread);
+
+
+
+  //! Real-time threads ready to run, by deadline
+
+  std::multimap<Time,Thread*> rtReady;
+
+
+
+  //! Real-time threads, by end of their current period
+
+  std::multimap<Time,Thread*> rtReleases;
+
+
+
+  int rt_utilization;         //!< Utilization of the real-time class,
+
+                              //!< in millionths of the CPU
+
+  bool release_armed;         //!< A release of jobs is scheduled
+
+  Time release_at;            //!< Tick of the scheduled release
+
+  bool rt_preempt_armed;      //!< A preemption for a real-time thread is
+
+                              //!< scheduled
+
+
+
+  int64_t quantum_number;     //!< Number of the current quantum
+
+  bool quantum_armed;         //!< The end of the quantum is scheduled
+
+  Time quantum_start;         //!< Start of the current quantum
+
+  bool idle;                  //!< The CPU waits for an interrupt
+
+  bool preempting;            //!< The next switch is a preemption
+
+
+
+  int nb_voluntary;           //!< Switches on Yield, Sleep or Finish
+
+  int nb_involuntary;         //!< Switches on the end of a quantum
+
+  int nb_demotions;           //!< Threads moved down (whole quantum used)
+
+  int nb_boosts;              //!< Threads moved up after blocking
+
+  int nb_agings;              //!< Threads moved up after waiting
+
+
+
+  int queue_length[SCHED_NB_LEVELS];     //!< Threads ready in each level
+
+  int max_queue_length[SCHED_NB_LEVELS]; //!< Maximum of queue_length
+
+  int64_t sum_queue_length[SCHED_NB_LEVELS]; //!< Sum of queue_length seen
+
+                                         //!< by the queued threads
+
+  int nb_queued[SCHED_NB_LEVELS];        //!< Threads queued in each level
+
+
+
+  int nb_rt_admitted;         //!< Threads admitted in the real-time class
+
+  int nb_rt_refused;          //!< Threads refused by the admission control
+
+  int nb_rt_jobs;             //!< Real-time jobs released
+
+  int nb_rt_misses;           //!< Jobs not complete at their deadline
+
+  int nb_rt_overruns;         //!< Jobs stopped at the end of their budget
 
 };
 
 
 
+void SchedulerQuantumExpired(int64_t quantum_number);
+
+void SchedulerReleaseJobs(int64_t arg);
+
+void SchedulerPreemptForRealTime(int64_t arg);
+
+void SchedulerThreadAlive(int64_t arg);
+
+
+
 #endif // SCHEDULER_H
 
@@ -0,0 +1,95 @@
+/*! \file switch.cc
+//  \brief Low-level switch of the simulator context on x86-64 Linux
+//
+//	The context of a thread that is not running is kept on its own
+//	stack: the registers that the System V AMD64 calling convention
+//	preserves across calls (rbx, rbp, r12-r15, the MXCSR control
+//	bits and the x87 control word), below the return address into
+//	the code that called SimulatorSwitch. Only the stack pointer is
+//	stored in the thread. The other registers are already saved by
+//	the compiler around the call.
+//
+//  Copyright (c) 1999-2000 INSA de Rennes.
+//  All rights reserved.
+//  See copyright_insa.h for copyright notice and limitation
+//  of liability and disclaimer of warranty provisions.
+*/
+
+#include "kernel/switch.h"
+
+#ifdef FAST_SIMULATOR_SWITCH
+
+// Layout of a saved context, from the saved stack pointer up
+#define SWITCH_REG_WORDS 6          // r15, r14, r13, r12, rbx, rbp,
+                                    // below one word holding MXCSR and
+                                    // the x87 control word
+
+#define SWITCH_DEFAULT_MXCSR 0x1f80 // all exceptions masked, round to nearest
+#define SWITCH_DEFAULT_FPUCW 0x037f // idem, double extended precision
+
+//----------------------------------------------------------------------
+// SimulatorSwitch
+/*!	Save the context of the running thread on its stack and store
+//	its stack pointer in *old_sp (rdi), then switch to the stack
+//	new_sp (rsi) and restore the context saved there. Returns in
+//	the thread that owns new_sp.
+*/
+//----------------------------------------------------------------------
+__asm__(
+"	.text\n"
+"	.globl	SimulatorSwitch\n"
+"	.type	SimulatorSwitch, @function\n"
+"SimulatorSwitch:\n"
+"	pushq	%rbp\n"
+"	pushq	%rbx\n"
+"	pushq	%r12\n"
+"	pushq	%r13\n"
+"	pushq	%r14\n"
+"	pushq	%r15\n"
+"	subq	$8, %rsp\n"
+"	stmxcsr	(%rsp)\n"
+"	fnstcw	4(%rsp)\n"
+"	movq	%rsp, (%rdi)\n"
+"	movq	%rsi, %rsp\n"
+"	ldmxcsr	(%rsp)\n"
+"	fldcw	4(%rsp)\n"
+"	addq	$8, %rsp\n"
+"	popq	%r15\n"
+"	popq	%r14\n"
+"	popq	%r13\n"
+"	popq	%r12\n"
+"	popq	%rbx\n"
+"	popq	%rbp\n"
+"	ret\n"
+"	.size	SimulatorSwitch, .-SimulatorSwitch\n"
+);
+
+//----------------------------------------------------------------------
+// SimulatorInitStack
+/*!	Build on a new stack the context that SimulatorSwitch restores,
+//	so that the first switch to it "returns" into func, with the
+//	stack aligned as at the entry of a function. The callee-saved
+//	registers start at zero, the control registers at their default
+//	value.
+//
+//	\param stack is the lowest address of the stack
+//	\param stack_size is the size of the stack in bytes
+//	\param func is the function to run, which must not return
+//	\return the stack pointer to pass to SimulatorSwitch
+*/
+//----------------------------------------------------------------------
+void *SimulatorInitStack(int8_t *stack, unsigned long stack_size,
+			 void (*func)(void))
+{
+  // Top of the stack, aligned on 16 bytes
+  uint64_t *sp = (uint64_t *)(((uintptr_t)(stack + stack_size)) & ~(uintptr_t)15);
+
+  *--sp = 0;                        // return address of func (none)
+  *--sp = (uint64_t)(uintptr_t)func; // return address of SimulatorSwitch
+  for (int i = 0; i < SWITCH_REG_WORDS; i++)
+    *--sp = 0;                      // rbp, rbx, r12-r15
+  *--sp = ((uint64_t)SWITCH_DEFAULT_FPUCW << 32) | SWITCH_DEFAULT_MXCSR;
+  return sp;
+}
+
+#endif // FAST_SIMULATOR_SWITCH
@@ -0,0 +1,40 @@
+/*! \file switch.h
+    \brief Low-level switch of the simulator context between threads
+
+    Each Nachos thread runs on its own host stack. Switching threads
+    only has to save the registers the host calling convention asks a
+    function to preserve, switch the stack pointer, and restore the
+    registers of the other thread. On x86-64 Linux, this is done by
+    SimulatorSwitch, without any system call. Elsewhere, the threads
+    fall back on swapcontext, which also saves and restores the signal
+    mask.
+
+    Copyright (c) 1999-2000 INSA de Rennes.
+    All rights reserved.
+    See copyright_insa.h for copyright notice and limitation
+    of liability and disclaimer of warranty provisions.
+*/
+
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define FAST_SIMULATOR_SWITCH
+#endif
+
+#ifdef FAST_SIMULATOR_SWITCH
+
+//! Save the callee-saved registers on the current stack, store the
+//! stack pointer in *old_sp, and resume the context saved at new_sp
+extern "C" void SimulatorSwitch(void **old_sp, void *new_sp);
+
+//! Prepare a stack so that switching to the returned stack pointer
+//! calls func, which must not return
+void *SimulatorInitStack(int8_t *stack, unsigned long stack_size,
+			 void (*func)(void));
+
+#endif // FAST_SIMULATOR_SWITCH
+
+#endif // SWITCH_H
@@ -0,0 +1,93 @@
+/*! \file switchbench.cc
+//  \brief Host benchmark of the simulator context switch
+//
+//	Two contexts switch back and forth, first with swapcontext (as
+//	the threads did before), then with SimulatorSwitch, and the
+//	number of switches per second of the host is printed for both.
+//	This is a host program, not part of the kernel:
+//
+//	    cd kernel && make switchbench && ./switchbench [switches]
+//
+//  Copyright (c) 1999-2000 INSA de Rennes.
+//  All rights reserved.
+//  See copyright_insa.h for copyright notice and limitation
+//  of liability and disclaimer of warranty provisions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+#include "kernel/switch.h"
+
+#define BENCH_STACK_SIZE (32 * 1024)  // same as SIMULATORSTACKSIZE
+#define BENCH_DEFAULT_SWITCHES 1000000
+
+static long nb_rounds;                 // round trips to do
+
+static ucontext_t main_uc, peer_uc;    // swapcontext contexts
+
+#ifdef FAST_SIMULATOR_SWITCH
+static void *main_sp, *peer_sp;        // SimulatorSwitch contexts
+#endif
+
+static double Now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void PeerUcontext()
+{
+  for (;;)
+    swapcontext(&peer_uc, &main_uc);
+}
+
+#ifdef FAST_SIMULATOR_SWITCH
+static void PeerFast()
+{
+  for (;;)
+    SimulatorSwitch(&peer_sp, main_sp);
+}
+#endif
+
+static void Report(const char *name, double seconds)
+{
+  long switches = 2 * nb_rounds;
+  printf("%-16s %10ld switches in %.3f s: %12.0f switches/s, %6.1f ns/switch\n",
+	 name, switches, seconds, switches / seconds,
+	 seconds * 1e9 / switches);
+}
+
+int main(int argc, char **argv)
+{
+  long switches = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_SWITCHES;
+  nb_rounds = (switches + 1) / 2;
+  int8_t *stack = new int8_t[BENCH_STACK_SIZE];
+
+  // swapcontext: saves and restores the signal mask (a system call)
+  getcontext(&peer_uc);
+  peer_uc.uc_stack.ss_sp = stack;
+  peer_uc.uc_stack.ss_size = BENCH_STACK_SIZE;
+  peer_uc.uc_link = NULL;
+  makecontext(&peer_uc, PeerUcontext, 0);
+  double start = Now();
+  for (long i = 0; i < nb_rounds; i++)
+    swapcontext(&main_uc, &peer_uc);
+  Report("swapcontext", Now() - start);
+
+#ifdef FAST_SIMULATOR_SWITCH
+  // SimulatorSwitch: callee-saved registers and stack pointer only
+  peer_sp = SimulatorInitStack(stack, BENCH_STACK_SIZE, PeerFast);
+  start = Now();
+  for (long i = 0; i < nb_rounds; i++)
+    SimulatorSwitch(&main_sp, peer_sp);
+  Report("SimulatorSwitch", Now() - start);
+#else
+  printf("SimulatorSwitch is not available on this host\n");
+#endif
+
+  delete [] stack;
+  return 0;
+}
@@ -120,6 +120,10 @@ void Semaphore::V() {
 }
 
 
+int Lock::nb_inversions = 0;
+int Lock::nb_inheritances = 0;
+int Lock::max_chain = 0;
+
 //----------------------------------------------------------------------
 // Lock::Lock
 /*! 	Initialize a Lock, so that it can be used for synchronization.
@@ -130,9 +134,9 @@ void Semaphore::V() {
 Lock::Lock(char* debugName) {
     name = new char[strlen(debugName)+1];
     strcpy(name,debugName);
-    sleepqueue = new Listint;
     free = true;
     owner = NULL;
+    next_held = NULL;
     type = LOCK_TYPE;
 }
 
@@ -140,14 +144,23 @@ Lock::Lock(char* debugName) {
 //----------------------------------------------------------------------
 // Lock::~Lock
 /*! 	De-allocate lock, when no longer needed. Assumes that no thread
-//      is waiting on the lock.
+//      is waiting on the lock. A lock still held is removed from the
+//      locks held by its owner.
 */
 //----------------------------------------------------------------------
 Lock::~Lock() {
     type = INVALID_TYPE;
-    ASSERT(sleepqueue->IsEmpty());
+    ASSERT(waiters.empty());
+    if (owner != NULL) {
+        IntStatus old_status = g_machine->interrupt->SetStatus(IntStatus::INTERRUPTS_OFF);
+        Lock **held = &owner->sched.locks_held;
+        while ((*held != NULL) && (*held != this))
+            held = &(*held)->next_held;
+        if (*held == this)
+            *held = next_held;
+        g_machine->interrupt->SetStatus(old_status);
+    }
     delete [] name;
-    delete sleepqueue;
 }
 
 //----------------------------------------------------------------------
@@ -157,6 +170,10 @@ Lock::~Lock() {
 //	atomically, so we need to disable interrupts before checking
 //	the value of free.
 //
+//	A thread that has to wait gives its priority to the holder of
+//	the lock, if higher (priority inheritance). The lock is handed
+//	over by Release, so the thread holds it when woken up.
+//
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
 */
@@ -171,19 +188,85 @@ void Lock::Acquire() {
     if (free == true) {
         free = false;
         owner = g_current_thread;
+        next_held = owner->sched.locks_held;
+        owner->sched.locks_held = this;
     } else {
-        sleepqueue->Append((void*) g_current_thread);
+        int level = g_scheduler->EffectiveLevel(g_current_thread);
+        if (level < g_scheduler->EffectiveLevel(owner)) {
+            DEBUG('t', (char *)"Priority inversion: thread \"%s\" waits "
+                  "for lock \"%s\" held by thread \"%s\"\n",
+                  g_current_thread->GetName(), name, owner->GetName());
+            nb_inversions++;
+        }
+        g_current_thread->sched.lock_waiting = this;
+        g_current_thread->sched.lock_pos =
+            waiters.insert(std::make_pair(level, g_current_thread));
+        Inherit(level);
         g_current_thread->Sleep();
     }
     g_machine->interrupt->SetStatus(old_status);
 #endif
 }
 
+//----------------------------------------------------------------------
+// Lock::Inherit
+/*! 	Raise the holder of the lock to the level of a new waiter, then
+//	the holder of the lock it waits for itself, and so on, until a
+//	holder already has this level or does not wait. The holders
+//	waiting for a lock are moved in its waiters accordingly.
+//
+//	\param level is the effective level of the new waiter
+*/
+//----------------------------------------------------------------------
+void Lock::Inherit(int level) {
+    int chain = 0;
+    Lock *lock = this;
+    while ((lock != NULL) && (lock->owner != NULL)) {
+        Thread *holder = lock->owner;
+        if (g_scheduler->EffectiveLevel(holder) <= level)
+            break;
+        DEBUG('t', (char *)"Thread \"%s\" inherits level %d\n",
+              holder->GetName(), level);
+        g_scheduler->SetInheritedLevel(holder, level);
+        nb_inheritances++;
+        chain++;
+        lock = holder->sched.lock_waiting;
+        if (lock != NULL) {
+            lock->waiters.erase(holder->sched.lock_pos);
+            holder->sched.lock_pos =
+                lock->waiters.insert(std::make_pair(level, holder));
+        }
+    }
+    if (chain > max_chain)
+        max_chain = chain;
+}
+
+//----------------------------------------------------------------------
+// Lock::Restore
+/*! 	Recompute the level a thread inherits: the one of the highest
+//	waiter of the locks it still holds, if any.
+//
+//	\param thread is the thread
+*/
+//----------------------------------------------------------------------
+void Lock::Restore(Thread *thread) {
+    int level = SCHED_NB_LEVELS;
+    for (Lock *lock = thread->sched.locks_held; lock != NULL;
+         lock = lock->next_held) {
+        if (!lock->waiters.empty() && (lock->waiters.begin()->first < level))
+            level = lock->waiters.begin()->first;
+    }
+    g_scheduler->SetInheritedLevel(thread, level);
+}
+
 
 //----------------------------------------------------------------------
 // Lock::Release
 /*! 	Wake up a waiter if necessary, or release it if no thread is waiting.
 //      We check that the lock is held by the g_current_thread.
+//	The lock is handed over to the waiter of highest priority, and
+//	the priority the releasing thread inherited from the waiters of
+//	this lock is given up.
 //	As with Acquire, this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that threads
 //	are disabled when it is called.
@@ -199,14 +282,25 @@ void Lock::Release() {
     IntStatus old_status = g_machine->interrupt->SetStatus(IntStatus::INTERRUPTS_OFF);
 
     if (isHeldByCurrentThread()) {
-        if (sleepqueue->IsEmpty()) {
+        Lock **held = &owner->sched.locks_held;
+        while (*held != this)
+            held = &(*held)->next_held;
+        *held = next_held;
+        if (waiters.empty()) {
             free = true;
             owner = NULL;
         } else {
-            Thread* nextThread = (Thread*) sleepqueue->Remove();
+            Thread* nextThread = waiters.begin()->second;
+            waiters.erase(waiters.begin());
+            nextThread->sched.lock_waiting = NULL;
             owner = nextThread;
+            next_held = owner->sched.locks_held;
+            owner->sched.locks_held = this;
+            // the remaining waiters now wait for the new owner
+            Restore(nextThread);
             g_scheduler->ReadyToRun(nextThread);
         }
+        Restore(g_current_thread);
     } else {
         printf("g_current_thread is not the owner of this lock.");
     }
@@ -20,6 +20,7 @@
 #include "kernel/system.h"
 #include "kernel/thread.h"
 #include "utility/list.h"
+#include <map>
 
 /*! \brief Defines the "semaphore" synchronization tool
 //
@@ -74,6 +75,12 @@ public:
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// The lock is given to its waiters by priority (effective level in
+// the scheduler), FIFO among equals. A thread holding a lock inherits
+// the priority of the highest waiter of the lock, and so on along
+// the chain of locks the holder waits for itself. The inherited
+// priority is recomputed from the locks still held on release.
 */
 class Lock {
 public:
@@ -95,12 +102,27 @@ public:
   //! true if the current thread holds this lock.  Useful for checking
   //! in Release, and in Condition variable operations below.
   bool isHeldByCurrentThread();	 
+
+  //! Number of threads blocked by the holder of a lock of lower
+  //! priority, of priorities raised by inheritance, and length of the
+  //! longest chain of locks the inheritance went through
+  static int nb_inversions, nb_inheritances, max_chain;
   
 private:
+  //! Give the priority of a waiter to the holders of the chain of
+  //! locks starting at this one
+  void Inherit(int level);
+
+  //! Recompute the level a thread inherits from the locks it holds
+  static void Restore(Thread *thread);
+
   char* name;            //!< for debugging
-  Listint * sleepqueue;  //!< threads waiting to acquire the lock
+  std::multimap<int,Thread*> waiters;
+                         //!< threads waiting to acquire the lock,
+                         //!< by effective level
   bool free;             //!< to know if the lock is free
   Thread * owner;        //!< Thread who has acquired the lock
+  Lock * next_held;      //!< Next lock held by the owner
 
 public:
   //! Object type, for validity checks during system calls (must be the first public field)
@@ -18,14 +18,20 @@
 
 #include "kernel/scheduler.h"
 
+#include "kernel/timerwheel.h"
+
 #include "kernel/msgerror.h"
 
 #include "drivers/drvConsole.h"
 
 #include "drivers/drvDisk.h"
 
+#include "drivers/bufcache.h"
+
 #include "drivers/drvACIA.h"
 
+#include "drivers/transport.h"
+
 #include "utility/config.h"
 
 #include "utility/utility.h"
@@ -72,6 +78,8 @@ Listint *g_alive;                        //!< List of existing threads
 
 Scheduler *g_scheduler;			//!< Thread scheduler
 
+TimerWheel *g_timer_wheel;		//!< Timed sleeps of the threads
+
 
 
 // Device drivers
@@ -84,6 +92,10 @@ DriverConsole *g_console_driver;         //!< Console driver
 
 DriverACIA *g_acia_driver;               //!< Serial line driver
 
+BufferCache *g_buffer_cache;             //!< Sector buffer cache
+
+Transport *g_transport;                  //!< Reliable transport over the ACIA
+
 
 
 // Other Nachos components
@@ -302,10 +314,24 @@ Initialize(int argc, char **argv)
 
   // Create the device drivers
 
-  g_disk_driver = new DriverDisk((char*)"sem disk",(char*)"lock disk",g_machine->disk);
+  g_disk_driver = new DriverDisk((char*)"disk",g_machine->disk);
+
+  g_buffer_cache = NULL;
+
+  if (g_cfg->BufferCacheSize > 0) {
+
+    g_buffer_cache = new BufferCache(g_cfg->BufferCacheSize);
+
+    g_disk_driver->SetCache(g_buffer_cache);
+
+  }
 
   if (g_cfg->ACIA) g_acia_driver = new DriverACIA();
 
+  g_transport = NULL;
+
+  if (g_cfg->ACIA == ACIA_INTERRUPT) g_transport = new Transport();
+
   g_console_driver = new DriverConsole();
 
 
@@ -314,6 +340,8 @@ Initialize(int argc, char **argv)
 
   g_scheduler = new Scheduler();		// Initialize the ready queue
 
+  g_timer_wheel = new TimerWheel();
+
   g_page_fault_manager = new PageFaultManager();
 
   g_swap_manager = new SwapManager();
@@ -430,6 +458,30 @@ Cleanup()
 
 {
 
+  // Start the write-back of the dirty sectors while the current
+
+  // thread exists, so that the statistics of the buffer cache and of
+
+  // the disk count it
+
+  if (g_buffer_cache != NULL) g_buffer_cache->Flush();
+
+
+
+  // Wait for the pending requests, writes behind included, while
+
+  // there is still a thread to sleep
+
+  if (g_current_thread != NULL) {
+
+    g_disk_driver->Drain();
+
+    g_swap_disk_driver->Drain();
+
+  }
+
+
+
   // Delete currently executing thread if any This has to be done
 
   // because the last running thread, even if finished, is not deleted
@@ -448,6 +500,12 @@ Cleanup()
 
 
 
+  // Send the buffered console output before the statistics
+
+  g_console_driver->Flush();
+
+
+
   // Clean all global objects
 
   printf("\nCleaning up...\n");    
@@ -456,8 +514,30 @@ Cleanup()
 
     g_stats->Print();
 
+    g_scheduler->PrintStat();
+
+    g_timer_wheel->Print();
+
+    g_swap_manager->Print();
+
+    if (g_buffer_cache != NULL) g_buffer_cache->Print();
+
+    g_disk_driver->Print();
+
+    g_swap_disk_driver->Print();
+
+    g_console_driver->Print();
+
+    if (g_cfg->ACIA) g_acia_driver->Print();
+
+    if (g_transport != NULL) g_transport->Print();
+
   }
 
+  if (g_transport != NULL) delete g_transport;
+
+  if (g_buffer_cache != NULL) delete g_buffer_cache;
+
   delete g_disk_driver;
 
   delete g_console_driver;
@@ -472,6 +552,8 @@ Cleanup()
 
   delete g_swap_manager;
 
+  delete g_timer_wheel;
+
   delete g_scheduler;
 
   delete g_stats;
@@ -76,6 +76,8 @@ class Thread;
 
 class Scheduler;
 
+class TimerWheel;
+
 class PageFaultManager;
 
 class PhysicalMemManager;
@@ -92,6 +94,10 @@ class DriverConsole;
 
 class DriverACIA;
 
+class BufferCache;
+
+class Transport;
+
 class Machine;
 
 
@@ -130,6 +136,8 @@ extern Listint *g_alive;                        //!< List of existing threads
 
 extern Scheduler *g_scheduler;			//!< Thread scheduler
 
+extern TimerWheel *g_timer_wheel;		//!< Timed sleeps of the threads
+
 
 
 // Device drivers
@@ -142,6 +150,10 @@ extern DriverConsole *g_console_driver;         //!< Console driver
 
 extern DriverACIA *g_acia_driver;               //!< Serial line driver
 
+extern BufferCache *g_buffer_cache;             //!< Sector buffer cache
+
+extern Transport *g_transport;                  //!< Reliable transport over the ACIA
+
 
 
 // Other Nachos components
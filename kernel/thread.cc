@@ -16,6 +16,7 @@
 // of liability and disclaimer of warranty provisions.
 
 #include "kernel/thread.h"
+#include "drivers/drvConsole.h"
 #include "kernel/msgerror.h"
 #include "kernel/synch.h"
 #include "kernel/scheduler.h"
@@ -26,6 +27,13 @@
 					// simulator stack, for detecting
 					// stack overflows
 
+// Thread whose floating point registers are in the machine: they are
+// only saved when another thread that uses them runs
+static Thread *fp_owner = NULL;
+
+int Thread::nb_fp_switches = 0;
+int Thread::nb_fp_skipped = 0;
+
 //----------------------------------------------------------------------
 // Thread::Thread
 /*! 	Constructor. Initialize an empty thread (just a name)
@@ -41,6 +49,36 @@ Thread::Thread(char *threadName)
 
   // No process owner yet
   process = NULL;
+
+  // Disk requests come from file accesses unless told otherwise
+  io_origin = 0;
+  fp_used = false;
+  vp = false;
+
+  // Nobody waits for the thread yet
+  finished = false;
+  exit_status = 0;
+  join_waiters = new Listint;
+
+  sched.level = 0;
+  sched.blocked = false;
+  sched.ready_since = 0;
+  sched.level_since = 0;
+  sched.vruntime = 0;
+  sched.rt_period = 0;
+  sched.rt_budget = 0;
+  sched.rt_deadline = 0;
+  sched.rt_remaining = 0;
+  sched.rt_job_done = false;
+  sched.rt_waiting = false;
+  sched.rt_queued = false;
+  sched.rt_nb_jobs = sched.rt_misses = sched.rt_overruns = 0;
+  sched.sleep_since = 0;
+  sched.run_ticks = sched.wait_ticks = sched.sleep_ticks = 0;
+  sched.nb_voluntary = sched.nb_involuntary = 0;
+  sched.inherited = SCHED_NB_LEVELS;
+  sched.lock_waiting = NULL;
+  sched.locks_held = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -68,6 +106,12 @@ Thread::~Thread() {
     if (this !=g_current_thread)
       DeallocBoundedArray(simulator_context.stackBottom,simulator_context.stackSize);
 
+    // Its floating point registers need not be saved anymore
+    if (fp_owner == this)
+      fp_owner = NULL;
+
+    delete join_waiters;
+
     // NB: the thread stack itself is not freed, we do not attempt to
     // reuse the address space dedicated to stack The corresponding
     // physical memory will be deallocated when the process will be
@@ -111,6 +155,8 @@ int Thread::Start(Process *owner, int32_t func, int arg) {
     process = owner;
     process->numThreads++;
     type = THREAD_TYPE;
+    sched.level = process->priority;
+    fp_used = process->uses_fp;
 
     // allocating memory and context
     stackPointer = process->addrspace->StackAllocate();
@@ -142,6 +188,9 @@ void Thread::InitThreadContext(int32_t initialPCREG, int32_t initialSP, int32_t
 
     for (i = 0; i < NUM_INT_REGS; i++)
 	thread_context.int_registers[i] = 0;
+    for (i = 0; i < NUM_FP_REGS; i++)
+	thread_context.float_registers[i] = 0;
+    thread_context.cc = 0;
 
     // Initial program counter -- must be location of "Start"
     thread_context.int_registers[PC_REG] = initialPCREG;
@@ -195,6 +244,12 @@ void Thread::InitSimulatorContext(int8_t* base_stack_addr,
 
     ASSERT(base_stack_addr != NULL);
 
+#ifdef FAST_SIMULATOR_SWITCH
+    // Build on the stack the context that the first switch to the
+    // thread restores, returning into StartThreadExecution
+    simulator_context.sp = SimulatorInitStack(base_stack_addr, stack_size,
+					      StartThreadExecution);
+#else
     // Fill in buf with the current context
     // and then fill busf such that StartThreadExecution
     // will be called when a setcontext will be made on buf
@@ -207,6 +262,7 @@ void Thread::InitSimulatorContext(int8_t* base_stack_addr,
     simulator_context.buf.uc_stack.ss_flags = 0;
     simulator_context.buf.uc_link = NULL;
     makecontext(&simulator_context.buf,StartThreadExecution,0);
+#endif
 
     // Setup kernel stack parameters for low-level context switch
     simulator_context.stackBottom = base_stack_addr;
@@ -219,14 +275,22 @@ void Thread::InitSimulatorContext(int8_t* base_stack_addr,
 //----------------------------------------------------------------------
 // Thread::Join
 /*!
-//      Sleep the thread until another thread finishes.
+//      Sleep the thread until another thread finishes. The thread is
+//      put in the join queue of the other one, which wakes it up in
+//      Finish: it is not scheduled again before.
 //	\param Idthread thread to wait for
+//	\return the exit status of Idthread
 //----------------------------------------------------------------------
 */
-void Thread::Join(Thread *Idthread) {
-    while (g_alive->Search(Idthread)) {
-        Yield();
+int Thread::Join(Thread *Idthread) {
+    IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    if (!Idthread->finished) {
+        Idthread->join_waiters->Append((void *)this);
+        Sleep();
     }
+    ASSERT(Idthread->finished);
+    g_machine->interrupt->SetStatus(oldLevel);
+    return Idthread->exit_status;
 }
 
 //----------------------------------------------------------------------
@@ -264,9 +328,12 @@ Thread::CheckOverflow()
 //
 // 	NOTE: we disable interrupts, so that we don't get a time slice
 //	between setting g_thread_to_be_destroyed and going to sleep.
+//
+//	\param status is the exit status, returned to the threads that
+//	join this one
 */
 //----------------------------------------------------------------------
-void Thread::Finish () {
+void Thread::Finish (int status) {
     DEBUG('t', (char *)"Finishing thread \"%s\"\n", GetName());
 #ifndef ETUDIANTS_TP
     printf("**** Warning: method Thread::Finish is not fully implemented yet\n");
@@ -276,6 +343,20 @@ void Thread::Finish () {
     IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
     g_thread_to_be_destroyed = this;
     g_alive->RemoveItem(this);
+
+    // Wake up the threads that wait for this one
+    finished = true;
+    exit_status = status;
+    while (!join_waiters->IsEmpty())
+      g_scheduler->ReadyToRun((Thread *)join_waiters->Remove());
+
+    g_scheduler->SetRealTime(this, 0, 0);
+    g_scheduler->ThreadFinished(this);
+    // A virtual processor gives up its right to run user code,
+    // without starting a new one
+    if (vp && (process->vp_active == this))
+      process->ReleaseProcessor(this, false);
+    vp = false;
     Sleep();  // invokes SWITCH
 #endif
 }
@@ -339,6 +420,13 @@ void Thread::Sleep () {
     ASSERT(g_machine->interrupt->GetStatus() == INTERRUPTS_OFF);
 
     DEBUG('t', (char *)"Sleeping thread \"%s\"\n", GetName());
+    // A virtual processor that blocks lets another one run the
+    // user-level threads of its process. It gets the right back on
+    // its return to user mode (see ExceptionHandler)
+    if (vp && (process->vp_active == this))
+      process->ReleaseProcessor(this, true);
+    sched.blocked = true;
+    sched.sleep_since = g_stats->getTotalTicks();
 
     // In case, there is nobody else to execute, we wait for an
     // interrupt In case there is no interrupt to come in the future,
@@ -349,9 +437,16 @@ void Thread::Sleep () {
     // would need to be fixed
     while ((nextThread = g_scheduler->FindNextToRun()) == NULL) {
     	DEBUG('t', (char *)"Nobody to run => idle\n");
+        // nobody can read the console now: stop polling it, or its
+        // interrupts would keep Nachos running when all the threads
+        // left are blocked for ever
+        g_console_driver->SystemIdle(true);
         // no one to run, wait for an interrupt
+        g_scheduler->SetIdle(true);
     	g_machine->interrupt->Idle();
     }
+    g_scheduler->SetIdle(false);
+    g_console_driver->SystemIdle(false);
 
     // Once we have another thread to execute, perform the context switch
     g_scheduler->SwitchTo(nextThread);
@@ -367,7 +462,9 @@ AddrSpace* Thread::getAddrSpace() {
 
 //----------------------------------------------------------------------
 // Thread::SaveProcessorState
-/*!	Save the CPU state of a user program on a context switch
+/*!	Save the CPU state of a user program on a context switch. The
+//	floating point registers stay in the machine, they are saved
+//	when another thread needs them (see RestoreProcessorState).
 */
 //----------------------------------------------------------------------
 void Thread::SaveProcessorState() {
@@ -380,17 +477,30 @@ void Thread::SaveProcessorState() {
     for (int i = 0; i < NUM_INT_REGS; i++) {
         thread_context.int_registers[i] = g_machine->ReadIntRegister(i);
     }
-    // saving floating point registers
+#endif
+}
+
+//----------------------------------------------------------------------
+// Thread::SaveFPState
+/*!	Save the floating point registers, and the condition code set by
+//	the floating point comparisons, in the thread context.
+*/
+//----------------------------------------------------------------------
+void Thread::SaveFPState() {
     for (int i = 0; i < NUM_FP_REGS; i++) {
         thread_context.float_registers[i] = g_machine->ReadFPRegister(i);
     }
     thread_context.cc = g_machine->ReadCC();
-#endif
 }
 
 //----------------------------------------------------------------------
 // Thread::RestoreProcessorState
 /*!	Restore the CPU state of a user program on a context switch.
+//
+//	The floating point registers are switched lazily: they are only
+//	restored for the threads of programs that have floating point
+//	instructions, and only if another such thread used them since
+//	this one last ran. The registers of that thread are saved first.
 */
 //----------------------------------------------------------------------
 
@@ -403,28 +513,37 @@ void Thread::RestoreProcessorState() {
     for (int i = 0; i < NUM_INT_REGS; i++) {
         g_machine->WriteIntRegister(i, thread_context.int_registers[i]);
     }
-    for (int i = 0; i < NUM_FP_REGS; i++) {
-        g_machine->WriteFPRegister(i, thread_context.float_registers[i]);
+    if (fp_used && (fp_owner != this)) {
+        if (fp_owner != NULL)
+            fp_owner->SaveFPState();
+        for (int i = 0; i < NUM_FP_REGS; i++) {
+            g_machine->WriteFPRegister(i, thread_context.float_registers[i]);
+        }
+        g_machine->WriteCC(thread_context.cc);
+        fp_owner = this;
+        nb_fp_switches++;
+    } else {
+        nb_fp_skipped++;
     }
-    g_machine->WriteCC(thread_context.cc);
     g_machine->mmu->translationTable = process->addrspace->translationTable;
 #endif
 }
 
 //----------------------------------------------------------------------
-// Thread::SaveSimulatorState
-/*!	Save the simulator state.
-*/
-//----------------------------------------------------------------------
-void Thread::SaveSimulatorState() {
-  getcontext(&(simulator_context.buf));
-}
-
-//----------------------------------------------------------------------
-// Thread::RestoreSimulatorState
-/*!	Restore simulator state.
+// Thread::SwitchSimulatorState
+/*!	Save the simulator state of the thread, and restore the one of
+//	nextThread. Returns when another thread switches back to this
+//	one. On x86-64 Linux, only the callee-saved registers and the
+//	stack pointer are switched (see switch.h), otherwise swapcontext
+//	is used.
+//
+//	\param nextThread is the thread to resume
 */
 //----------------------------------------------------------------------
-void Thread::RestoreSimulatorState() {
-  setcontext(&(simulator_context.buf));
+void Thread::SwitchSimulatorState(Thread *nextThread) {
+#ifdef FAST_SIMULATOR_SWITCH
+  SimulatorSwitch(&(simulator_context.sp), nextThread->simulator_context.sp);
+#else
+  swapcontext(&(simulator_context.buf), &(nextThread->simulator_context.buf));
+#endif
 }
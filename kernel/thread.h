@@ -15,6 +15,7 @@
 */
 
 class Thread;
+class Lock;
 
 #ifndef THREAD_H
 #define THREAD_H
@@ -25,7 +26,9 @@ class Thread;
 #include "kernel/process.h"
 #include "utility/utility.h"
 #include "utility/stats.h"
+#include "kernel/switch.h"
 #include <ucontext.h>
+#include <map>
 
 // Size of the simulator's execution stack
 #define SIMULATORSTACKSIZE	(32 * 1024) // in Bytes
@@ -39,7 +42,11 @@ class Process;
 /*! \brief Defines the context of the Nachos simulator
 */
 typedef struct {
+#ifdef FAST_SIMULATOR_SWITCH
+  void *sp;               //!< Stack pointer, the context is on the stack
+#else
   ucontext_t buf;
+#endif
   int8_t *stackBottom;
   int stackSize;
 } simulatorContextT;
@@ -61,6 +68,60 @@ typedef struct {
 } threadContextT;
 
 
+/*! \brief Defines the scheduling state of a thread, managed by the
+    scheduler
+*/
+typedef struct {
+  //! Level in the multi-level feedback queue (0: highest)
+  int level;
+  //! The thread blocked since it last ran (moves up when woken up)
+  bool blocked;
+  //! Tick the thread was last put in the ready list
+  Time ready_since;
+  //! Tick the thread entered its ready list level (aging)
+  Time level_since;
+  //! CPU time used, for the Fair policy
+  int64_t vruntime;
+
+  //! Period of a real-time thread, in ticks (0: not real-time)
+  int rt_period;
+  //! CPU time a real-time thread may use in each period, in ticks
+  int rt_budget;
+  //! Deadline of the current job (end of the current period)
+  Time rt_deadline;
+  //! CPU time left to the current job
+  int64_t rt_remaining;
+  //! The current job is complete, or out of budget
+  bool rt_job_done;
+  //! The thread sleeps until its next period
+  bool rt_waiting;
+  //! The thread is in the real-time ready list
+  bool rt_queued;
+  //! Position in the real-time ready list
+  std::multimap<Time,Thread*>::iterator rt_ready_pos;
+  //! Position in the list of the next releases
+  std::multimap<Time,Thread*>::iterator rt_release_pos;
+  //! Number of jobs, of deadline misses and of budget overruns
+  int rt_nb_jobs, rt_misses, rt_overruns;
+
+  //! Tick the thread last went to sleep
+  Time sleep_since;
+  //! Time spent running, waiting in the ready list and sleeping
+  Time run_ticks, wait_ticks, sleep_ticks;
+  //! Switches on Yield, Sleep or Finish, and on preemption
+  int nb_voluntary, nb_involuntary;
+
+  //! Level inherited from the waiters of the locks held by the thread
+  //! (SCHED_NB_LEVELS: none)
+  int inherited;
+  //! Lock the thread waits to acquire, NULL if none
+  Lock *lock_waiting;
+  //! Position in the waiters of that lock
+  std::multimap<int,Thread*>::iterator lock_pos;
+  //! Locks held by the thread, linked by Lock::next_held
+  Lock *locks_held;
+} schedStateT;
+
 /*! \brief Data structures for managing threads
  *
  */
@@ -75,8 +136,9 @@ public:
   //! Start a thread, attaching it to a process (return NoError on success)
   int Start(Process *owner, int32_t func, int arg);
 
-  //! Wait for another thread to finish its execution
-  void Join(Thread *Idthread);
+  //! Wait for another thread to finish its execution, and return
+  //! its exit status
+  int Join(Thread *Idthread);
 
   //! Relinquish the CPU if any other thread is runnable.
   void Yield();
@@ -85,7 +147,7 @@ public:
   void Sleep();
 
   //! Finish the execution of the thread, and prepare its deallocation
-  void Finish();
+  void Finish(int status = 0);
 
   //! Check if a thread has overflowed its stack.
   void CheckOverflow();
@@ -106,15 +168,22 @@ public:
   //! Restore the processor registers.
   void RestoreProcessorState();
 
-  //! Save the state of the Nachos simulator.
-  void SaveSimulatorState();
+  //! Number of switches of the floating point registers, and of
+  //! switches that did not need it (lazy floating point switch)
+  static int nb_fp_switches, nb_fp_skipped;
 
-  //! Restore Nachos simulator state.
-  void RestoreSimulatorState();
+  //! Save the state of the Nachos simulator, and restore the one of
+  //! nextThread. Returns when the thread runs again.
+  void SwitchSimulatorState(Thread *nextThread);
 
   char* GetName() { return (name); }
   Process* GetProcessOwner() { return process; }
 
+  //! Origin of the disk requests issued by the thread (DiskOrigin,
+  //  used for the disk statistics)
+  int GetIoOrigin() { return io_origin; }
+  void SetIoOrigin(int origin) { io_origin = origin; }
+
 protected:
   //! Thread name (for debugging)
   char* name;
@@ -128,9 +197,30 @@ protected:
   //! Thread context
   threadContextT thread_context;
 
+  //! Origin of the disk requests issued by the thread
+  int io_origin;
+
+  //! The thread may use the floating point registers
+  bool fp_used;
+
+  //! The thread has finished, with status exit_status
+  bool finished;
+  int exit_status;
+
+  //! Threads waiting in Join for the thread to finish
+  Listint *join_waiters;
+
+  //! Save the floating point registers in the thread context
+  void SaveFPState();
+
 public:
   //! signature to make sure the thread is in the correct state
   ObjectType type;
+  //! Scheduling state
+  schedStateT sched;
+  //! Virtual processor of the user-level thread runtime of its
+  //! process (see Process::SetUpcall)
+  bool vp;
 
   int stackPointer;
 };
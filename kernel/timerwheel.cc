@@ -0,0 +1,244 @@
+/*! \file timerwheel.cc
+//  \brief Routines of the timer wheel of the sleeping threads
+//
+//	A timer is put in the lowest level whose range covers its delay:
+//	level l holds the timers that expire within TIMER_WHEEL_SIZE^(l+1)
+//	wheel ticks, in the slot given by bits [l*TIMER_WHEEL_BITS,
+//	(l+1)*TIMER_WHEEL_BITS[ of their expiry. When level 0 wraps
+//	around, the next slot of level 1 is cascaded, and so on up.
+//
+//  Copyright (c) 1999-2000 INSA de Rennes.
+//  All rights reserved.
+//  See copyright_insa.h for copyright notice and limitation
+//  of liability and disclaimer of warranty provisions.
+*/
+
+#include "kernel/system.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "kernel/timerwheel.h"
+
+//----------------------------------------------------------------------
+// TimerWheelExpire
+/*! 	Timer interrupt handler of the wheel. Need this to be a C
+//	routine, because C++ can't handle pointers to member functions.
+*/
+//----------------------------------------------------------------------
+void TimerWheelExpire(int64_t arg)
+{
+  ((TimerWheel *)arg)->Expire();
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::TimerWheel
+/*! 	Constructor. Initialize an empty wheel.
+*/
+//----------------------------------------------------------------------
+TimerWheel::TimerWheel()
+{
+  for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+    for (int i = 0; i < TIMER_WHEEL_SIZE; i++)
+      slots[l][i] = NULL;
+    occupied[l] = 0;
+  }
+  now = 0;
+  nb_timers = 0;
+  armed = false;
+  armed_at = 0;
+  nb_sleeps = max_timers = nb_interrupts = nb_cascaded = 0;
+  sum_lateness = 0;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::~TimerWheel
+/*! 	Destructor. The timers belong to the sleeping threads.
+*/
+//----------------------------------------------------------------------
+TimerWheel::~TimerWheel()
+{
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Sleep
+/*! 	Put the current thread to sleep for a number of ticks. It is
+//	woken up at the first wheel tick after this delay.
+//
+//	\param ticks is the delay, in simulated ticks
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Sleep(Time ticks)
+{
+  if (ticks == 0)
+    return;
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  WheelTimer timer;
+  Time start = g_stats->getTotalTicks();
+  uint64_t current = start / TIMER_WHEEL_RESOLUTION;
+  timer.thread = g_current_thread;
+  timer.expires = (start + ticks + TIMER_WHEEL_RESOLUTION - 1)
+    / TIMER_WHEEL_RESOLUTION;
+
+  // An empty wheel does not need to catch up with the time
+  if (nb_timers == 0)
+    now = current;
+  DEBUG('t', (char *)"Thread \"%s\" sleeps until wheel tick %llu\n",
+	g_current_thread->GetName(), (unsigned long long)timer.expires);
+  Add(&timer);
+  nb_sleeps++;
+  if (nb_timers > max_timers)
+    max_timers = nb_timers;
+  Arm();
+  g_current_thread->Sleep();
+
+  sum_lateness += g_stats->getTotalTicks() - (start + ticks);
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Add
+/*! 	Put a timer in the slot of the lowest level whose range covers
+//	its delay. A delay beyond the range of the wheel is put in the
+//	last slot of the highest level, and will be cascaded there again.
+//
+//	\param timer is the timer to add
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Add(WheelTimer *timer)
+{
+  uint64_t expires = (timer->expires < now) ? now : timer->expires;
+  uint64_t delay = expires - now;
+  int level = 0;
+  while ((level < TIMER_WHEEL_LEVELS - 1)
+	 && (delay >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1)))))
+    level++;
+  uint64_t range = (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+  if (delay >= range)
+    expires = now + range - 1;
+  int slot = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+  timer->next = slots[level][slot];
+  slots[level][slot] = timer;
+  occupied[level] |= (uint64_t)1 << slot;
+  nb_timers++;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Cascade
+/*! 	Move the timers of the current slot of a level to the levels
+//	below, when the level below wraps around.
+//
+//	\param level is the level to cascade (at least 1)
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Cascade(int level)
+{
+  int slot = (now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+  WheelTimer *timer = slots[level][slot];
+  slots[level][slot] = NULL;
+  occupied[level] &= ~((uint64_t)1 << slot);
+  while (timer != NULL) {
+    WheelTimer *next = timer->next;
+    nb_timers--;
+    Add(timer);
+    nb_cascaded++;
+    timer = next;
+  }
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Advance
+/*! 	Process the wheel ticks up to until: cascade the higher levels
+//	when level 0 wraps around, and wake up the threads of each slot
+//	of level 0. The end of a rotation of level 0 is skipped at once
+//	when it has no timers left.
+//
+//	\param until is the last wheel tick to process
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Advance(uint64_t until)
+{
+  while (now <= until) {
+    int slot = now & TIMER_WHEEL_MASK;
+    if (slot == 0) {
+      for (int l = 1; l < TIMER_WHEEL_LEVELS; l++) {
+	Cascade(l);
+	if (((now >> (TIMER_WHEEL_BITS * l)) & TIMER_WHEEL_MASK) != 0)
+	  break;
+      }
+    }
+    if ((occupied[0] >> slot) == 0) {
+      // nothing left in this rotation of level 0
+      uint64_t next = (now | TIMER_WHEEL_MASK) + 1;
+      now = (next > until) ? until + 1 : next;
+      continue;
+    }
+    WheelTimer *timer = slots[0][slot];
+    slots[0][slot] = NULL;
+    occupied[0] &= ~((uint64_t)1 << slot);
+    while (timer != NULL) {
+      WheelTimer *next = timer->next;
+      nb_timers--;
+      DEBUG('t', (char *)"Waking up thread \"%s\" at wheel tick %llu\n",
+	    timer->thread->GetName(), (unsigned long long)now);
+      g_scheduler->ReadyToRun(timer->thread);
+      timer = next;
+    }
+    now++;
+  }
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Arm
+/*! 	Schedule the timer interrupt at the next wheel tick that has
+//	timers in level 0, or at the next cascade, unless an earlier
+//	interrupt is already scheduled.
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Arm()
+{
+  if (nb_timers == 0)
+    return;
+  int slot = now & TIMER_WHEEL_MASK;
+  uint64_t bits = occupied[0] >> slot;
+  uint64_t next = (bits != 0) ? now + __builtin_ctzll(bits)
+			      : (now | TIMER_WHEEL_MASK) + 1;
+  if (armed && (armed_at <= next))
+    return;
+  Time at = next * TIMER_WHEEL_RESOLUTION;
+  Time current = g_stats->getTotalTicks();
+  armed = true;
+  armed_at = next;
+  g_machine->interrupt->Schedule(TimerWheelExpire, (int64_t)this,
+				 (at > current) ? (int)(at - current) : 1,
+				 TIMER_INT);
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Expire
+/*! 	Timer interrupt handler: process the wheel up to the current
+//	wheel tick, then schedule the next interrupt.
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Expire()
+{
+  uint64_t current = g_stats->getTotalTicks() / TIMER_WHEEL_RESOLUTION;
+  if (armed && (current >= armed_at))
+    armed = false;
+  nb_interrupts++;
+  Advance(current);
+  Arm();
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Print
+/*! 	Print the statistics of the wheel.
+*/
+//----------------------------------------------------------------------
+void TimerWheel::Print()
+{
+  printf("Timer wheel: %d timed sleeps (max %d at once), %d interrupts, "
+	 "%d timers cascaded, mean wake-up delay %.1f ticks\n",
+	 nb_sleeps, max_timers, nb_interrupts, nb_cascaded,
+	 nb_sleeps ? (double)sum_lateness / nb_sleeps : 0.0);
+}
@@ -0,0 +1,84 @@
+/*! \file timerwheel.h
+    \brief Data structures of the timer wheel of the sleeping threads
+
+    Threads that sleep for a given time are kept in a hierarchical
+    timer wheel. Time is counted in wheel ticks of
+    TIMER_WHEEL_RESOLUTION simulated ticks. Level 0 has a slot per
+    wheel tick for the next TIMER_WHEEL_SIZE ticks. Each level above
+    has a slot per rotation of the level below, and its slots are
+    moved down (cascaded) as the levels below wrap around. Adding a
+    timer, and expiring the timers of a wheel tick, cost O(1) whatever
+    the number of sleeping threads. A single timer interrupt is
+    scheduled, at the next wheel tick that has timers, or at the next
+    cascade.
+
+    Copyright (c) 1999-2000 INSA de Rennes.
+    All rights reserved.
+    See copyright_insa.h for copyright notice and limitation
+    of liability and disclaimer of warranty provisions.
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "utility/stats.h"
+
+class Thread;
+
+#define TIMER_WHEEL_RESOLUTION 100  // simulated ticks per wheel tick
+#define TIMER_WHEEL_BITS 6          // log2 of the slots per level
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4        // range: 2^24 wheel ticks
+
+/*! \brief Defines a timer of the wheel: a sleeping thread. It lives
+    on the kernel stack of the thread while it sleeps. */
+typedef struct WheelTimer {
+  Thread *thread;           //!< Thread to wake up
+  uint64_t expires;         //!< Wheel tick of the expiry
+  struct WheelTimer *next;  //!< Next timer of the slot
+} WheelTimer;
+
+/*! \brief Defines the timer wheel */
+class TimerWheel {
+public:
+  //! Constructor. The wheel is empty
+  TimerWheel();
+
+  //! Destructor
+  ~TimerWheel();
+
+  //! Put the current thread to sleep for a number of ticks
+  void Sleep(Time ticks);
+
+  //! Timer interrupt handler: wake up the threads whose time is over
+  void Expire();
+
+  //! Print the statistics of the wheel
+  void Print();
+
+private:
+  void Add(WheelTimer *timer);
+  void Cascade(int level);
+  void Advance(uint64_t until);
+  void Arm();
+
+  WheelTimer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+                            //!< Timers of each slot
+  uint64_t occupied[TIMER_WHEEL_LEVELS];
+                            //!< Bit i is set if slot i has timers
+  uint64_t now;             //!< Next wheel tick to process
+  int nb_timers;            //!< Number of sleeping threads
+  bool armed;               //!< A timer interrupt is scheduled
+  uint64_t armed_at;        //!< Wheel tick of the scheduled interrupt
+
+  int nb_sleeps;            //!< Number of timed sleeps
+  int max_timers;           //!< Maximum of nb_timers
+  int nb_interrupts;        //!< Timer interrupts handled
+  int nb_cascaded;          //!< Timers moved down a level
+  int64_t sum_lateness;     //!< Sum of the wake-up delays, in ticks
+};
+
+void TimerWheelExpire(int64_t arg);
+
+#endif // TIMERWHEEL_H
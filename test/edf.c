@@ -0,0 +1,67 @@
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+#define NB_JOBS 16
+
+// Two periodic tasks, 40% + 30% of the CPU, and a background task
+// that computes until they are done: the periodic ones must meet
+// their deadlines, and a third one, 50% more, must be refused
+static volatile int stop = 0;
+
+static void work(int loops) {
+    volatile int i, x = 0;
+    for (i = 0; i < loops; i++)
+        x += i;
+}
+
+static void periodic(int period, int budget, int loops,
+                     VoidNoArgFunctionPtr admitted) {
+    int i;
+    ThreadId t = 0;
+    if (RealTime(period, budget) < 0) {
+        PError("RealTime");
+        return;
+    }
+    if (admitted != 0)
+        t = threadCreate("refused", admitted);
+    for (i = 0; i < NB_JOBS; i++) {
+        work(loops);
+        Yield();    // end of the job, wait for the next period
+    }
+    RealTime(0, 0);
+    if (t != 0)
+        Join(t);
+}
+
+void refused() {
+    if (RealTime(10000, 5000) < 0)
+        n_printf("third task refused, as expected\n");
+    else
+        n_printf("third task admitted: utilization over 100%%\n");
+}
+
+void fast() {
+    periodic(20000, 8000, 100, 0);
+    n_printf("fast task finished\n");
+}
+
+void slow() {
+    periodic(50000, 15000, 200, refused);
+    n_printf("slow task finished\n");
+}
+
+void background() {
+    while (!stop)
+        work(100);
+    n_printf("background task finished\n");
+}
+
+int main() {
+    ThreadId bg = threadCreate("background", background);
+    ThreadId t1 = threadCreate("fast", fast);
+    ThreadId t2 = threadCreate("slow", slow);
+    Join(t1);
+    Join(t2);
+    stop = 1;
+    Join(bg);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+#define NB_THREADS 256
+#define NB_ROUNDS 10
+#define STACK_SIZE 1024
+
+// Many green threads take turns incrementing a counter without any
+// lock (they are not preempted by one another). One of them sleeps in
+// the kernel meanwhile: the others must keep running on another
+// virtual processor.
+char stacks[NB_THREADS][STACK_SIZE];
+int counter = 0;
+int rounds_while_sleeping = 0;
+int sleeping = 0;
+
+void worker(int n) {
+    int i;
+    for (i = 0; i < NB_ROUNDS; i++) {
+        counter++;
+        if (sleeping)
+            rounds_while_sleeping++;
+        greenYield();
+    }
+}
+
+void sleeper(int n) {
+    sleeping = 1;
+    Sleep(20000);
+    sleeping = 0;
+}
+
+int main() {
+    int i;
+
+    greenCreate(sleeper, 0, stacks[0], STACK_SIZE);
+    for (i = 1; i < NB_THREADS; i++)
+        greenCreate(worker, i, stacks[i], STACK_SIZE);
+    greenRun();
+    n_printf("Counter: %d (expected %d), %d rounds while a thread slept\n",
+             counter, (NB_THREADS - 1) * NB_ROUNDS, rounds_while_sleeping);
+    return 0;
+}
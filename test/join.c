@@ -0,0 +1,31 @@
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+#define NB_THREADS 8
+
+// Each worker returns the square of its number: Join must return
+// these statuses, whether the worker finished before or after the
+// call to Join
+int worker(int n) {
+    int i;
+    for (i = 0; i < n; i++)
+        Yield();
+    return n * n;
+}
+
+int main() {
+    int i, status, errors = 0;
+    ThreadId threads[NB_THREADS];
+
+    for (i = 0; i < NB_THREADS; i++)
+        threads[i] = threadCreateArg("a worker", worker, i);
+    for (i = NB_THREADS - 1; i >= 0; i--) {
+        status = Join(threads[i]);
+        if (status != i * i) {
+            n_printf("Join of worker %d: status %d, expected %d\n",
+                     i, status, i * i);
+            errors++;
+        }
+    }
+    n_printf("Join: %s\n", errors ? "FAILED" : "ok");
+    return errors;
+}
@@ -0,0 +1,30 @@
+/* Parameters shared by netbench_a.c and netbench_b.c */
+#define NB_SIZES 4
+static int sizes[NB_SIZES] = {16, 64, 256, 1024};
+
+#define MAX_SIZE 1024        /* largest message, ACIA_MAX_MSG */
+#define NB_ROUNDTRIPS 32     /* round-trips measured for each size */
+#define BULK_BYTES 8192      /* bytes sent one way for each size */
+#define RAW_CREDIT 2048      /* raw bytes sent before waiting for the
+                                receiver, so that its ring never fills */
+#define BENCH_PORT 1         /* port of the connection */
+
+/* Number of raw messages of a given size sent before waiting (each
+   frame in the receive ring has a 4-byte header, FRAME_HEADER_SIZE) */
+static int raw_burst(int size) {
+    int burst = RAW_CREDIT / (size + 4);
+    return (burst > 0) ? burst : 1;
+}
+
+/* Receive exactly size bytes from a connection */
+static void conn_receive_all(ConnId conn, char *buff, int size) {
+    int got = 0;
+    while (got < size) {
+        int n = ConnReceive(conn, buff + got, size - got);
+        if (n < 0) {
+            PError("netbench: ConnReceive");
+            Exit(1);
+        }
+        got += n;
+    }
+}
@@ -0,0 +1,122 @@
+/* Benchmark of the serial link, measuring side. Run it with
+ * nachos_bench_A.cfg, and netbench_b with nachos_bench_B.cfg on the
+ * other machine.
+ *
+ * For raw ACIA messages (TtySend/TtyReceive), then for a reliable
+ * connection (ConnSend/ConnReceive), and for each message size, it
+ * measures the round-trip time of messages echoed by netbench_b, and
+ * the one-way throughput of a bulk transfer to netbench_b.
+ *
+ * Each result is printed on a line starting with "BENCH", followed by
+ * key=value pairs separated by spaces. Times are in microseconds of
+ * simulated time, throughputs in bytes per millisecond:
+ *   BENCH test=rtt link=raw size=64 n=32 min=... mean=... p50=... p90=... p99=... max=...
+ *   BENCH test=bulk link=conn size=64 bytes=8192 us=... bytes_per_ms=...
+ */
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+#include "netbench.h"
+
+static char message[MAX_SIZE + 1];
+static char reply[MAX_SIZE + 1];
+static int samples[NB_ROUNDTRIPS];
+
+/* Simulated time, in microseconds (an int would overflow after 2147
+ * seconds; the intervals measured fit in an int) */
+static long long now_us() {
+    Nachos_Time t;
+    SysTime(&t);
+    return (long long)t.seconds * 1000000 + t.nanos / 1000;
+}
+
+static void fill(int size) {
+    int i;
+    for (i = 0; i < size; i++)
+        message[i] = 'a' + i % 26;
+    message[size] = '\0';
+}
+
+static void print_rtt(char *link, int size) {
+    int i, j, sum = 0;
+    /* insertion sort of the samples, for the percentiles */
+    for (i = 1; i < NB_ROUNDTRIPS; i++) {
+        int v = samples[i];
+        for (j = i; (j > 0) && (samples[j - 1] > v); j--)
+            samples[j] = samples[j - 1];
+        samples[j] = v;
+    }
+    for (i = 0; i < NB_ROUNDTRIPS; i++)
+        sum += samples[i];
+    n_printf("BENCH test=rtt link=%s size=%d n=%d min=%d mean=%d p50=%d p90=%d p99=%d max=%d\n",
+             link, size, NB_ROUNDTRIPS, samples[0], sum / NB_ROUNDTRIPS,
+             samples[NB_ROUNDTRIPS * 50 / 100],
+             samples[NB_ROUNDTRIPS * 90 / 100],
+             samples[NB_ROUNDTRIPS * 99 / 100],
+             samples[NB_ROUNDTRIPS - 1]);
+}
+
+static void print_bulk(char *link, int size, int bytes, int us) {
+    n_printf("BENCH test=bulk link=%s size=%d bytes=%d us=%d bytes_per_ms=%d\n",
+             link, size, bytes, us, (us > 0) ? (bytes * 1000) / us : 0);
+}
+
+static void raw_bench(int size) {
+    int i, nb, burst;
+    long long start;
+    fill(size);
+    for (i = 0; i < NB_ROUNDTRIPS; i++) {
+        start = now_us();
+        TtySend(message);
+        TtyReceive(reply, MAX_SIZE);
+        samples[i] = (int)(now_us() - start);
+    }
+    print_rtt("raw", size);
+
+    nb = BULK_BYTES / size;
+    burst = raw_burst(size);
+    start = now_us();
+    for (i = 0; i < nb; i++) {
+        TtySend(message);
+        if (((i + 1) % burst == 0) || (i == nb - 1))
+            TtyReceive(reply, MAX_SIZE);    /* wait for the receiver */
+    }
+    print_bulk("raw", size, nb * size, (int)(now_us() - start));
+}
+
+static void conn_bench(ConnId conn, int size) {
+    int i, sent;
+    long long start;
+    fill(size);
+    for (i = 0; i < NB_ROUNDTRIPS; i++) {
+        start = now_us();
+        ConnSend(conn, message, size);
+        conn_receive_all(conn, reply, size);
+        samples[i] = (int)(now_us() - start);
+    }
+    print_rtt("conn", size);
+
+    start = now_us();
+    for (sent = 0; sent < BULK_BYTES; sent += size)
+        ConnSend(conn, message, size);
+    conn_receive_all(conn, reply, 1);       /* all received */
+    print_bulk("conn", size, BULK_BYTES, (int)(now_us() - start));
+}
+
+int main() {
+    int s;
+    ConnId conn;
+
+    for (s = 0; s < NB_SIZES; s++)
+        raw_bench(sizes[s]);
+
+    /* from now, the link carries connection segments only */
+    conn = ConnOpen(BENCH_PORT);
+    if (conn < 0) {
+        PError("netbench_a: ConnOpen");
+        return 1;
+    }
+    for (s = 0; s < NB_SIZES; s++)
+        conn_bench(conn, sizes[s]);
+    ConnClose(conn);
+    return 0;
+}
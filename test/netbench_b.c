@@ -0,0 +1,55 @@
+/* Benchmark of the serial link, echoing side: the counterpart of
+ * netbench_a, run with nachos_bench_B.cfg.
+ */
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+#include "netbench.h"
+
+static char buff[MAX_SIZE + 1];
+
+static void raw_bench(int size) {
+    int i, nb, burst;
+    for (i = 0; i < NB_ROUNDTRIPS; i++) {
+        TtyReceive(buff, MAX_SIZE);
+        buff[size] = '\0';
+        TtySend(buff);
+    }
+
+    nb = BULK_BYTES / size;
+    burst = raw_burst(size);
+    for (i = 0; i < nb; i++) {
+        TtyReceive(buff, MAX_SIZE);
+        if (((i + 1) % burst == 0) || (i == nb - 1))
+            TtySend("k");
+    }
+}
+
+static void conn_bench(ConnId conn, int size) {
+    int i, got;
+    for (i = 0; i < NB_ROUNDTRIPS; i++) {
+        conn_receive_all(conn, buff, size);
+        ConnSend(conn, buff, size);
+    }
+
+    for (got = 0; got < BULK_BYTES; got += size)
+        conn_receive_all(conn, buff, size);
+    ConnSend(conn, "k", 1);
+}
+
+int main() {
+    int s;
+    ConnId conn;
+
+    for (s = 0; s < NB_SIZES; s++)
+        raw_bench(sizes[s]);
+
+    conn = ConnOpen(BENCH_PORT);
+    if (conn < 0) {
+        PError("netbench_b: ConnOpen");
+        return 1;
+    }
+    for (s = 0; s < NB_SIZES; s++)
+        conn_bench(conn, sizes[s]);
+    ConnClose(conn);
+    return 0;
+}
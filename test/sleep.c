@@ -0,0 +1,33 @@
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+#define NB_THREADS 6
+
+// Each sleeper sleeps for a delay that decreases with its number:
+// they must wake up in the reverse order of their creation. A sleeper
+// returns 1 if it woke up out of order.
+int woken = 0;
+
+int sleeper(int n) {
+    int delay = (NB_THREADS - n) * 5000;
+    int in_order;
+
+    Sleep(delay);
+    in_order = (woken == NB_THREADS - 1 - n);
+    woken++;
+    if (!in_order)
+        n_printf("sleeper %d woke up out of order (delay %d ticks)\n",
+                 n, delay);
+    return !in_order;
+}
+
+int main() {
+    int i, errors = 0;
+    ThreadId threads[NB_THREADS];
+
+    for (i = 0; i < NB_THREADS; i++)
+        threads[i] = threadCreateArg("a sleeper", sleeper, i);
+    for (i = 0; i < NB_THREADS; i++)
+        errors += Join(threads[i]);
+    n_printf("Sleep: %s\n", errors ? "FAILED" : "ok");
+    return errors;
+}
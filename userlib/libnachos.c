@@ -58,6 +58,244 @@ ThreadId threadCreate(char * debug_name, VoidNoArgFunctionPtr func)
     return newThread(debug_name, (int)threadStart,(int)func);
 }
 
+/*! Function and argument of the thread being created by
+ *  threadCreateArg, until it starts (newThread passes one value) */
+static struct {
+  IntFunctionPtr func;
+  int arg;
+} threadArgStart;
+
+/*! Semaphore giving threadArgStart to one creator at a time */
+static SemId threadArgFree = -1;
+
+//----------------------------------------------------------------------
+// threadStartArg()
+/*!	Makes a thread created by threadCreateArg execute its function,
+//      then call Exit with the value it returns. threadArgStart is
+//      given back to the next creator as soon as it is read.
+*/
+//----------------------------------------------------------------------
+
+static void threadStartArg(int unused)
+{
+    IntFunctionPtr func = threadArgStart.func;
+    int arg = threadArgStart.arg;
+    V(threadArgFree);
+    Exit(func(arg));
+}
+
+//----------------------------------------------------------------------
+// threadCreateArg()
+/*!	 Creates a thread and makes it execute a function with an
+//      argument, through threadStartArg. The exit status of the
+//      thread is the value returned by the function.
+//
+//      \param name the name of the thread (for debugging purpose)
+//	\param func is the address of the function to execute.
+//	\param arg is the argument of func
+//	\return the thread, or a negative number if it was not created
+*/
+//----------------------------------------------------------------------
+ThreadId threadCreateArg(char * debug_name, IntFunctionPtr func, int arg)
+{
+    ThreadId id;
+
+    if (threadArgFree < 0)
+        threadArgFree = SemCreate("thread start", 1);
+    P(threadArgFree);
+    threadArgStart.func = func;
+    threadArgStart.arg = arg;
+    id = newThread(debug_name, (int)threadStartArg, 0);
+    if (id < 0)
+        V(threadArgFree);
+    return id;
+}
+
+//----------------------------------------------------------------------
+// User-level threads
+//
+//	The ready green threads are kept in a FIFO queue. Each virtual
+//	processor runs greenSchedule on its own stack: it switches to
+//	the first ready thread, and gets back when the thread yields or
+//	finishes. The kernel lets a single virtual processor run user
+//	code at a time, so these structures need no lock. The virtual
+//	processor running a thread is kept in $27 (greenGetVp).
+//----------------------------------------------------------------------
+
+/*! A virtual processor, on the stack of its kernel thread */
+typedef struct {
+  int sp;                  // saved stack pointer of greenSchedule
+  GreenThread *current;    // green thread running, 0 if none
+} GreenVp;
+
+// Assembly routines of userlib/sys.s
+extern void greenSwitch(int *save_sp, int new_sp);
+extern GreenVp *greenGetVp(void);
+extern void greenSetVp(GreenVp *vp);
+
+static GreenThread *green_ready_head = 0; // ready queue
+static GreenThread *green_ready_tail = 0;
+static int green_live = 0;        // green threads not finished
+static SemId green_done = -1;     // V'ed when all are finished
+static int green_running = 0;     // greenRun waits for green_done
+
+// Size of the registers saved by greenSwitch, and of the argument
+// area a MIPS function may use in the frame of its caller
+#define GREEN_SWITCH_FRAME 40
+#define GREEN_ARG_AREA 16
+
+static void greenEnqueue(GreenThread *g)
+{
+  g->next = 0;
+  if (green_ready_tail == 0)
+    green_ready_head = g;
+  else
+    green_ready_tail->next = g;
+  green_ready_tail = g;
+}
+
+//----------------------------------------------------------------------
+// greenStart()
+/*!	First function run by a green thread, returning into greenExit.
+*/
+//----------------------------------------------------------------------
+static void greenStart(void)
+{
+  GreenThread *g = greenGetVp()->current;
+  g->func(g->arg);
+  greenExit();
+}
+
+//----------------------------------------------------------------------
+// greenSchedule()
+/*!	Entry point of the virtual processors (see Upcall): run the ready
+//	green threads, then finish the kernel thread once none is ready.
+//	The last virtual processor, once all the green threads are
+//	finished, wakes up greenRun.
+//
+//	\param n is the number of the virtual processor
+*/
+//----------------------------------------------------------------------
+static void greenSchedule(int n)
+{
+  GreenVp vp;
+  GreenThread *g;
+
+  vp.current = 0;
+  greenSetVp(&vp);
+  while ((g = green_ready_head) != 0) {
+    green_ready_head = g->next;
+    if (green_ready_head == 0)
+      green_ready_tail = 0;
+    vp.current = g;
+    greenSwitch(&vp.sp, g->sp);
+    vp.current = 0;
+  }
+  if ((green_live == 0) && green_running) {
+    green_running = 0;
+    V(green_done);
+  }
+  Exit(0);
+}
+
+//----------------------------------------------------------------------
+// greenCreate()
+/*!	Create a green thread, ready to run. Its descriptor is put at the
+//	bottom of its stack, and the top of the stack is prepared so that
+//	switching to it returns into greenStart.
+//
+//	\param func is the function to run,
+//	\param arg is its argument,
+//	\param stack is the lowest address of the stack,
+//	\param size is the size of the stack, in bytes.
+//	\return the thread, 0 if the stack is too small.
+*/
+//----------------------------------------------------------------------
+GreenThread *greenCreate(void (*func)(int), int arg, void *stack, int size)
+{
+  GreenThread *g = (GreenThread *)(((uintptr_t)stack + 7) & ~7);
+  uintptr_t top = ((uintptr_t)stack + size) & ~7;
+  int *frame;
+
+  if (size < GREEN_MIN_STACK)
+    return 0;
+  g->func = func;
+  g->arg = arg;
+  frame = (int *)(top - GREEN_ARG_AREA - GREEN_SWITCH_FRAME);
+  n_memset(frame, 0, GREEN_SWITCH_FRAME);
+  frame[GREEN_SWITCH_FRAME / 4 - 1] = (int)greenStart;   // $31
+  g->sp = (int)frame;
+  green_live++;
+  greenEnqueue(g);
+  return g;
+}
+
+//----------------------------------------------------------------------
+// greenRun()
+/*!	Run the green threads: register greenSchedule as the upcall of
+//	the process, which starts a virtual processor, and wait until
+//	all the threads are finished. The calling thread is not a
+//	virtual processor, and must not be a green thread.
+*/
+//----------------------------------------------------------------------
+void greenRun(void)
+{
+  if (green_live == 0)
+    return;
+  if (green_done == -1)
+    green_done = SemCreate("green threads done", 0);
+  green_running = 1;
+  Upcall((int)greenSchedule);
+  P(green_done);
+}
+
+//----------------------------------------------------------------------
+// greenYield()
+/*!	Put the calling green thread at the end of the ready queue, and
+//	switch back to its virtual processor.
+*/
+//----------------------------------------------------------------------
+void greenYield(void)
+{
+  GreenVp *vp = greenGetVp();
+  GreenThread *g;
+
+  if ((vp == 0) || (vp->current == 0))
+    return;
+  g = vp->current;
+  greenEnqueue(g);
+  greenSwitch(&g->sp, vp->sp);
+}
+
+//----------------------------------------------------------------------
+// greenExit()
+/*!	Finish the calling green thread, and switch back to its virtual
+//	processor for good.
+*/
+//----------------------------------------------------------------------
+void greenExit(void)
+{
+  GreenVp *vp = greenGetVp();
+  GreenThread *g;
+
+  if ((vp == 0) || (vp->current == 0))
+    return;
+  g = vp->current;
+  green_live--;
+  greenSwitch(&g->sp, vp->sp);
+}
+
+//----------------------------------------------------------------------
+// greenSelf()
+/*!	\return the calling green thread, 0 if not a green thread.
+*/
+//----------------------------------------------------------------------
+GreenThread *greenSelf(void)
+{
+  GreenVp *vp = greenGetVp();
+  return (vp != 0) ? vp->current : 0;
+}
+
 //----------------------------------------------------------------------
 // n_strcmp()
 /*!	String comparison
@@ -548,6 +786,321 @@ int n_snprintf(char * buff, int len, const char *format, ...){
   return len;
 }
 
+//----------------------------------------------------------------------
+// Buffered streams
+//----------------------------------------------------------------------
+
+static N_FILE n_streams[N_FOPEN_MAX] = {
+  { CONSOLE_INPUT,  N_IOLBF, 0, 0, 0, 0, -1 },
+  { CONSOLE_OUTPUT, N_IOFBF, 0, 0, 0, 0, -1 },
+  { -1, 0, 0, 0, 0, 0, -1 }, { -1, 0, 0, 0, 0, 0, -1 },
+  { -1, 0, 0, 0, 0, 0, -1 }, { -1, 0, 0, 0, 0, 0, -1 },
+  { -1, 0, 0, 0, 0, 0, -1 }, { -1, 0, 0, 0, 0, 0, -1 }
+};
+
+N_FILE *n_stdin = &n_streams[0];
+N_FILE *n_stdout = &n_streams[1];
+
+//----------------------------------------------------------------------
+// n_flock()
+/*!	Take the lock of a stream, creating it at the first use.
+//
+//	\param f the stream
+*/
+//----------------------------------------------------------------------
+static void n_flock(N_FILE *f)
+{
+  if (f->lock < 0)
+    f->lock = SemCreate("stream", 1);
+  P(f->lock);
+}
+
+//----------------------------------------------------------------------
+// n_funlock()
+/*!	Release the lock of a stream.
+//
+//	\param f the stream
+*/
+//----------------------------------------------------------------------
+static void n_funlock(N_FILE *f)
+{
+  V(f->lock);
+}
+
+//----------------------------------------------------------------------
+// n_fflush_locked()
+/*!	Write the data buffered for writing on a stream, or drop the
+//	data buffered for reading (see n_fflush). The lock of the
+//	stream must be held.
+//
+//	\param f the stream
+//	\return 0 on success, -1 on error
+*/
+//----------------------------------------------------------------------
+static int n_fflush_locked(N_FILE *f)
+{
+  int ret = 0;
+
+  if (f->writing) {
+    if (f->len > 0) {
+      int written = Write(f->buf, f->len, f->fd);
+      if (written != f->len)
+	ret = -1;
+      if (written > 0)
+	f->fpos += written;
+    }
+  }
+  else if ((f->pos < f->len) && (f->fd != CONSOLE_INPUT)) {
+    f->fpos -= f->len - f->pos;
+    if (Seek(f->fpos, f->fd) < 0)
+      ret = -1;
+  }
+  f->writing = 0;
+  f->pos = 0;
+  f->len = 0;
+  return ret;
+}
+
+//----------------------------------------------------------------------
+// n_fopen()
+/*!	Open a fully buffered stream on a Nachos file.
+//
+//	\param name the name of the file
+//	\return the stream, 0 on error
+*/
+//----------------------------------------------------------------------
+N_FILE *n_fopen(char *name)
+{
+  int i;
+  OpenFileId fd;
+
+  for (i = 0 ; i < N_FOPEN_MAX ; i++)
+    if (n_streams[i].fd == -1)
+      break;
+  if (i == N_FOPEN_MAX)
+    return 0;
+  fd = Open(name);
+  if (fd < 0)
+    return 0;
+  n_streams[i].fd = fd;
+  n_streams[i].mode = N_IOFBF;
+  n_streams[i].writing = 0;
+  n_streams[i].pos = 0;
+  n_streams[i].len = 0;
+  n_streams[i].fpos = 0;
+  return &n_streams[i];
+}
+
+//----------------------------------------------------------------------
+// n_fclose()
+/*!	Flush and close a stream opened by n_fopen.
+//
+//	\param f the stream
+//	\return 0 on success, -1 on error
+*/
+//----------------------------------------------------------------------
+int n_fclose(N_FILE *f)
+{
+  int ret = n_fflush(f);
+  if (Close(f->fd) < 0)
+    ret = -1;
+  f->fd = -1;
+  return ret;
+}
+
+//----------------------------------------------------------------------
+// n_setvbuf()
+/*!	Set the buffering mode of a stream (the buffered data is
+//	flushed first).
+//
+//	\param f the stream
+//	\param mode N_IOFBF or N_IOLBF
+//	\return 0 on success, -1 on error
+*/
+//----------------------------------------------------------------------
+int n_setvbuf(N_FILE *f, int mode)
+{
+  if ((mode != N_IOFBF) && (mode != N_IOLBF))
+    return -1;
+  n_flock(f);
+  n_fflush_locked(f);
+  f->mode = mode;
+  n_funlock(f);
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// n_fflush()
+/*!	Write the data buffered for writing on a stream. Data buffered
+//	for reading is dropped, going back in the file to the first
+//	byte not read yet.
+//
+//	\param f the stream
+//	\return 0 on success, -1 on error
+*/
+//----------------------------------------------------------------------
+int n_fflush(N_FILE *f)
+{
+  int ret;
+
+  n_flock(f);
+  ret = n_fflush_locked(f);
+  n_funlock(f);
+  return ret;
+}
+
+//----------------------------------------------------------------------
+// n_fflushall()
+/*!	Flush all the streams. Called by Exit, so that no buffered
+//	output is lost when a program ends.
+*/
+//----------------------------------------------------------------------
+void n_fflushall(void)
+{
+  int i;
+
+  for (i = 0 ; i < N_FOPEN_MAX ; i++)
+    if ((n_streams[i].fd != -1) && n_streams[i].writing)
+      n_fflush(&n_streams[i]);
+}
+
+//----------------------------------------------------------------------
+// n_fwrite()
+/*!	Write bytes on a stream. The bytes are buffered, and written
+//	when the buffer is full, or at each '\n' for a line buffered
+//	stream. Writes larger than the buffer go directly to the file.
+//
+//	\param buf the bytes to write
+//	\param size the number of bytes
+//	\param f the stream
+//	\return the number of bytes written, -1 on error
+*/
+//----------------------------------------------------------------------
+int n_fwrite(const void *buf, int size, N_FILE *f)
+{
+  const char *p = (const char *)buf;
+  int i, newline = 0;
+
+  n_flock(f);
+  if (!f->writing) {
+    if (n_fflush_locked(f) < 0) {       // drop the read-ahead
+      n_funlock(f);
+      return -1;
+    }
+    f->writing = 1;
+  }
+
+  if (f->len + size > N_BUFSIZ) {
+    if (n_fflush_locked(f) < 0) {
+      n_funlock(f);
+      return -1;
+    }
+    f->writing = 1;
+    if (size > N_BUFSIZ) {
+      int written = Write((char *)p, size, f->fd);
+      if (written > 0)
+	f->fpos += written;
+      n_funlock(f);
+      return written;
+    }
+  }
+
+  for (i = 0 ; (i < size) && (f->len < N_BUFSIZ) ; i++) {
+    f->buf[f->len++] = p[i];
+    if (p[i] == '\n')
+      newline = 1;
+  }
+  if ((f->mode == N_IOLBF) && newline && (n_fflush_locked(f) < 0)) {
+    n_funlock(f);
+    return -1;
+  }
+  n_funlock(f);
+  return size;
+}
+
+//----------------------------------------------------------------------
+// n_fread()
+/*!	Read bytes from a stream. The buffer is refilled with a single
+//	Read when empty. On the console, a read ends at the end of a
+//	line, as Read does.
+//
+//	\param buf the buffer to fill
+//	\param size the maximum number of bytes to read
+//	\param f the stream
+//	\return the number of bytes read, 0 at the end of the file,
+//	-1 on error
+*/
+//----------------------------------------------------------------------
+int n_fread(void *buf, int size, N_FILE *f)
+{
+  char *p = (char *)buf;
+  int n = 0;
+
+  // the output to the console is shown before waiting for input
+  if (f == n_stdin)
+    n_fflush(n_stdout);
+  n_flock(f);
+  if (f->writing && (n_fflush_locked(f) < 0)) {
+    n_funlock(f);
+    return -1;
+  }
+
+  while (n < size) {
+    if (f->pos == f->len) {
+      int got;
+      if ((n > 0) && (f->fd == CONSOLE_INPUT))
+	break;
+      // keep room for the '\0' ending the console input
+      got = Read(f->buf, N_BUFSIZ - 1, f->fd);
+      if (got <= 0) {
+	if (n == 0)
+	  n = got;
+	break;
+      }
+      f->fpos += got;
+      f->pos = 0;
+      f->len = got;
+    }
+    while ((n < size) && (f->pos < f->len)) {
+      char c = f->buf[f->pos++];
+      p[n++] = c;
+      if ((c == '\n') && (f->fd == CONSOLE_INPUT))
+	size = n;               // a console read ends with the line
+    }
+  }
+  n_funlock(f);
+  return n;
+}
+
+//----------------------------------------------------------------------
+// n_vfprintf()
+/*!	Print on a stream parameters (internal function). The output is
+//	formatted into a stack buffer, of the size of the output if it
+//	is larger than 200 bytes, so that nothing is truncated.
+*/
+//----------------------------------------------------------------------
+static void n_vfprintf(N_FILE *f, const char *format, va_list ap)
+{
+  char buff[200];
+  va_list ap2;
+  int len;
+
+  va_copy(ap2, ap);
+  len = n_vsnprintf(buff, sizeof(buff), format, ap);
+  if (len < 0) {
+    va_end(ap2);
+    return;
+  }
+  if (len >= sizeof(buff)) {
+    char large[len + 1];
+    n_vsnprintf(large, len + 1, format, ap2);
+    n_fwrite(large, len, f);
+  }
+  else
+    n_fwrite(buff, len, f);
+  va_end(ap2);
+}
+
 //----------------------------------------------------------------------
 // n_printf()
 /*!	Print to the standard output parameters.
@@ -572,17 +1125,28 @@ void poupou(const char * format, ...) {
 void n_printf(const char *format, ...){
 
   va_list ap;
-  char buff[200];
-  int len;
 
   va_start(ap, format);
-  len = n_vsnprintf(buff, sizeof(buff), format, ap);
+  n_vfprintf(n_stdout, format, ap);
   va_end(ap);
+}
 
-  if (len >= sizeof(buff))
-    len = sizeof(buff) - 1;
-  if (len > 0)
-  Write(buff,len,CONSOLE_OUTPUT);
+//----------------------------------------------------------------------
+// n_fprintf()
+/*!	Print on a stream parameters (same formats as n_printf).
+//
+//	\param f the stream
+//	\param format the string to parse
+//	\param ... the (variable number of) arguments
+*/
+//----------------------------------------------------------------------
+void n_fprintf(N_FILE *f, const char *format, ...){
+
+  va_list ap;
+
+  va_start(ap, format);
+  n_vfprintf(f, format, ap);
+  va_end(ap);
 }
 
 //----------------------------------------------------------------------
@@ -594,6 +1158,7 @@ void n_printf(const char *format, ...){
 //----------------------------------------------------------------------
 int n_read_int(void) {
   char buff[200];
+  n_fflush(n_stdout);
   Read(buff,200,CONSOLE_INPUT);
   return n_atoi(buff);
 }
@@ -20,12 +20,62 @@
 #include "userlib/syscall.h"
 
 typedef void (*VoidNoArgFunctionPtr)(); 
+typedef int (*IntFunctionPtr)(int);
 typedef unsigned int size_t;
 
 // Thread management
 // ----------------------------
 ThreadId threadCreate(char * debug_name, VoidNoArgFunctionPtr func);
 
+// Create a thread running func(arg): the thread exits with the value
+// returned by func, which Join returns. The first call must not be
+// concurrent with another one (it creates the semaphore of the calls)
+ThreadId threadCreateArg(char * debug_name, IntFunctionPtr func, int arg);
+
+// User-level threads :
+// --------------------
+
+/*! A user-level (green) thread. Green threads are switched by the
+ *  library, without system calls, and run over a few kernel threads
+ *  (virtual processors, see Upcall in userlib/syscall.h): when one of
+ *  them blocks in the kernel, the others keep running. They are not
+ *  preempted by one another: a green thread runs until it calls
+ *  greenYield or greenExit, or returns, or blocks in the kernel. The
+ *  floating point registers are not preserved by greenYield.
+ *
+ *  A kernel Lock belongs to the kernel thread that acquired it, that
+ *  is to the virtual processor, not to the green thread: a green
+ *  thread must not call greenYield while it holds one, since another
+ *  green thread of the same virtual processor that acquires it then
+ *  deadlocks (it waits for a lock its own kernel thread holds). */
+typedef struct GreenThread {
+  int sp;                     // saved stack pointer
+  void (*func)(int);          // function of the thread, and its
+  int arg;                    //   argument
+  struct GreenThread *next;   // next thread of the ready queue
+} GreenThread;
+
+// Smallest stack of a green thread (n_printf needs about 512 bytes)
+#define GREEN_MIN_STACK 1024
+
+// Create a green thread running func(arg), on the stack of size bytes
+// starting at stack (its descriptor is put at the bottom of the
+// stack). Return 0 if the stack is too small. The thread runs once
+// greenRun is called, and the stack may be reused when greenRun returns
+GreenThread *greenCreate(void (*func)(int), int arg, void *stack, int size);
+
+// Run the green threads until all of them are finished
+void greenRun(void);
+
+// Let the other ready green threads run
+void greenYield(void);
+
+// Finish the calling green thread
+void greenExit(void);
+
+// Return the calling green thread (0 if not a green thread)
+GreenThread *greenSelf(void);
+
 // Input/Output operations :
 // ------------------------------------
 
@@ -38,6 +88,65 @@ int n_snprintf(char * buff, int len, const char *format, ...);
 // Read an integer on the standard input
 int n_read_int(void);
 
+// Buffered streams :
+// ------------------
+
+// Size of the buffer of a stream
+#define N_BUFSIZ 512
+
+// Maximum number of streams opened at the same time (including
+// n_stdin and n_stdout)
+#define N_FOPEN_MAX 8
+
+// Buffering modes of a stream
+#define N_IOFBF 0   // fully buffered: written when the buffer is full
+#define N_IOLBF 1   // line buffered: also written at each '\n'
+
+/*! A buffered stream, on the console or on an open file. Each stream
+ *  has a lock, created at its first use, so that several threads may
+ *  write on it: the output of one call is never mixed with another
+ *  one. */
+typedef struct {
+  OpenFileId fd;     // file (or console) of the stream, -1 if unused
+  int mode;          // N_IOFBF or N_IOLBF
+  int writing;       // the buffer holds data to write (1) or read (0)
+  int pos;           // next byte to read in the buffer
+  int len;           // number of bytes in the buffer
+  int fpos;          // position of the file after the last Read/Write
+  SemId lock;        // serializes the use of the stream, -1 until used
+  char buf[N_BUFSIZ];
+} N_FILE;
+
+// Streams on the console input and output. n_stdout is fully
+// buffered: it is written when full, before reading n_stdin, and by
+// Exit and Halt (use n_setvbuf to write it at each '\n')
+extern N_FILE *n_stdin;
+extern N_FILE *n_stdout;
+
+// Open a stream on the Nachos file "name" (fully buffered)
+N_FILE *n_fopen(char *name);
+
+// Flush and close a stream.
+int n_fclose(N_FILE *f);
+
+// Set the buffering mode of a stream
+int n_setvbuf(N_FILE *f, int mode);
+
+// Write size bytes on a stream, return the number of bytes written
+int n_fwrite(const void *buf, int size, N_FILE *f);
+
+// Read at most size bytes from a stream, return the number of bytes read
+int n_fread(void *buf, int size, N_FILE *f);
+
+// Write the buffered data of a stream
+int n_fflush(N_FILE *f);
+
+// Flush all the streams (called by Exit and Halt)
+void n_fflushall(void);
+
+// Print on a stream specified parameters.
+void n_fprintf(N_FILE *f, const char *format, ...);
+
 // String operations :
 // -------------------
 
@@ -104,13 +104,27 @@ __start:
 
 
 
+/* Halt and Exit first flush the buffered streams of libnachos, if
+
+ * the program is linked with it (they do not return, so $16 and $31
+
+ * need not be preserved) */
+
+	.weak n_fflushall
+
 	.globl Halt
 
 	.ent	Halt
 
 Halt:
 
-	addiu $2,$0,SC_HALT
+	la	$2,n_fflushall
+
+	beq	$2,$0,1f
+
+	jal	n_fflushall
+
+1:	addiu $2,$0,SC_HALT
 
 	syscall
 
@@ -126,6 +140,16 @@ Halt:
 
 Exit:
 
+	move	$16,$4
+
+	la	$2,n_fflushall
+
+	beq	$2,$0,1f
+
+	jal	n_fflushall
+
+1:	move	$4,$16
+
 	addiu $2,$0,SC_EXIT
 
 	syscall
@@ -644,3 +668,313 @@ Mmap:	addiu $2,$0,SC_MMAP
 
 	.end Mmap
 
+
+
+	.globl ConsoleMode
+
+	.ent	ConsoleMode
+
+ConsoleMode:
+
+	addiu $2,$0,SC_CONSOLE_MODE
+
+	syscall
+
+	j	$31
+
+	.end ConsoleMode
+
+
+
+	.globl ConnOpen
+
+	.ent	ConnOpen
+
+ConnOpen:
+
+	addiu $2,$0,SC_CONN_OPEN
+
+	syscall
+
+	j	$31
+
+	.end ConnOpen
+
+
+
+	.globl ConnClose
+
+	.ent	ConnClose
+
+ConnClose:
+
+	addiu $2,$0,SC_CONN_CLOSE
+
+	syscall
+
+	j	$31
+
+	.end ConnClose
+
+
+
+	.globl ConnSend
+
+	.ent	ConnSend
+
+ConnSend:
+
+	addiu $2,$0,SC_CONN_SEND
+
+	syscall
+
+	j	$31
+
+	.end ConnSend
+
+
+
+	.globl ConnReceive
+
+	.ent	ConnReceive
+
+ConnReceive:
+
+	addiu $2,$0,SC_CONN_RECEIVE
+
+	syscall
+
+	j	$31
+
+	.end ConnReceive
+
+
+
+	.globl IoPriority
+
+	.ent	IoPriority
+
+IoPriority:
+
+	addiu $2,$0,SC_IO_PRIORITY
+
+	syscall
+
+	j	$31
+
+	.end IoPriority
+
+
+
+	.globl Quantum
+
+	.ent	Quantum
+
+Quantum:
+
+	addiu $2,$0,SC_QUANTUM
+
+	syscall
+
+	j	$31
+
+	.end Quantum
+
+
+
+	.globl Nice
+
+	.ent	Nice
+
+Nice:
+
+	addiu $2,$0,SC_NICE
+
+	syscall
+
+	j	$31
+
+	.end Nice
+
+
+
+	.globl RealTime
+
+	.ent	RealTime
+
+RealTime:
+
+	addiu $2,$0,SC_REALTIME
+
+	syscall
+
+	j	$31
+
+	.end RealTime
+
+
+
+	.globl Weight
+
+	.ent	Weight
+
+Weight:
+
+	addiu $2,$0,SC_WEIGHT
+
+	syscall
+
+	j	$31
+
+	.end Weight
+
+
+
+	.globl Sleep
+
+	.ent	Sleep
+
+Sleep:
+
+	addiu $2,$0,SC_SLEEP
+
+	syscall
+
+	j	$31
+
+	.end Sleep
+
+
+
+	.globl Upcall
+
+	.ent	Upcall
+
+Upcall:
+
+	addiu $2,$0,SC_UPCALL
+
+	syscall
+
+	j	$31
+
+	.end Upcall
+
+
+
+/* -------------------------------------------------------------
+
+ * Context switch of the user-level threads of libnachos (greenRun)
+
+ *
+
+ *	greenSwitch(int *save_sp, int new_sp) saves the registers the
+
+ *	callee must preserve ($16-$23, $30 and $31) on the current
+
+ *	stack and its pointer in *save_sp, then restores the ones saved
+
+ *	on the stack new_sp and returns there. No system call is made.
+
+ *	The floating point registers are not saved.
+
+ *
+
+ *	The virtual processor running a user-level thread is kept in
+
+ *	$27, which user code does not use, and which the kernel saves
+
+ *	with the other registers of each kernel thread.
+
+ * -------------------------------------------------------------
+
+ */
+
+
+
+	.globl greenSwitch
+
+	.ent	greenSwitch
+
+greenSwitch:
+
+	addiu	$29,$29,-40
+
+	sw	$16,0($29)
+
+	sw	$17,4($29)
+
+	sw	$18,8($29)
+
+	sw	$19,12($29)
+
+	sw	$20,16($29)
+
+	sw	$21,20($29)
+
+	sw	$22,24($29)
+
+	sw	$23,28($29)
+
+	sw	$30,32($29)
+
+	sw	$31,36($29)
+
+	sw	$29,0($4)
+
+	move	$29,$5
+
+	lw	$16,0($29)
+
+	lw	$17,4($29)
+
+	lw	$18,8($29)
+
+	lw	$19,12($29)
+
+	lw	$20,16($29)
+
+	lw	$21,20($29)
+
+	lw	$22,24($29)
+
+	lw	$23,28($29)
+
+	lw	$30,32($29)
+
+	lw	$31,36($29)
+
+	addiu	$29,$29,40
+
+	j	$31
+
+	.end greenSwitch
+
+
+
+	.globl greenGetVp
+
+	.ent	greenGetVp
+
+greenGetVp:
+
+	move	$2,$27
+
+	j	$31
+
+	.end greenGetVp
+
+
+
+	.globl greenSetVp
+
+	.ent	greenSetVp
+
+greenSetVp:
+
+	move	$27,$4
+
+	j	$31
+
+	.end greenSetVp
+
@@ -62,6 +62,18 @@
 #define SC_FSLIST        31
 #define SC_SYS_TIME	 32 
 #define SC_MMAP		 33 
+#define SC_IO_PRIORITY	 34
+#define SC_CONSOLE_MODE	 35
+#define SC_CONN_OPEN	 36
+#define SC_CONN_CLOSE	 37
+#define SC_CONN_SEND	 38
+#define SC_CONN_RECEIVE	 39
+#define SC_QUANTUM	 40
+#define SC_NICE		 41
+#define SC_REALTIME	 42
+#define SC_WEIGHT	 43
+#define SC_SLEEP	 44
+#define SC_UPCALL	 45
 
 #ifndef IN_ASM
 
@@ -103,6 +115,8 @@ ThreadId Exec(char *name);
 ThreadId newThread(char * debug_name, int func, int arg);
  
 /* Only return once the the thread "id" has finished. 
+ * Return the status it passed to Exit (0 if it returned from its
+ * function, or if it is already destroyed).
  */
 int Join(ThreadId id);
 
@@ -263,9 +277,130 @@ int TtySend(char *mess);
 */
 int TtyReceive(char *mess,int length);
 
+/* Console input modes: in canonical mode, a Read on the console
+   returns at the end of a line; in raw mode, it returns once the
+   requested number of characters is typed */
+#define CONSOLE_CANONICAL 0
+#define CONSOLE_RAW       1
+
+/* Set the console input mode.
+   Return the previous mode, or a negative number if an error ocurred.
+*/
+int ConsoleMode(int mode);
+
+/* Reliable connections over the serial link. A connection is
+   identified by a port number (0 to 7), opened on both machines;
+   the data sent on it is received in order, without loss. Once a
+   connection is opened, TtySend and TtyReceive must not be used.
+*/
+typedef int ConnId;
+
+/* Open the connection of a port.
+   Return the connection, or a negative number if an error ocurred.
+*/
+ConnId ConnOpen(int port);
+
+/* Close a connection, once all the data sent on it is received.
+   Return a negative number if an error ocurred, or if the other
+   side did not acknowledge the data after several timeouts (for
+   instance because it did not open the port): the data is dropped.
+*/
+int ConnClose(ConnId conn);
+
+/* Send size bytes on a connection. Return as soon as they are
+   queued, without waiting for the other side.
+   Return the number of bytes sent, or a negative number if an error ocurred.
+*/
+int ConnSend(ConnId conn, char *buffer, int size);
+
+/* Wait for bytes on a connection, and copy at most size of them
+   into buffer (at most one segment, 256 bytes, per call).
+   Return the number of bytes received, or a negative number if an error ocurred.
+*/
+int ConnReceive(ConnId conn, char *buffer, int size);
+
 /* Map an opened file in memory. Size is the size to be mapped in bytes.
 */
 int Mmap(OpenFileId f, int size);
 
+/******************************************************************/
+/* System calls concerning scheduling */
+
+/* I/O priority classes of a process: the disk requests of interactive
+   processes are served before those of background processes (the
+   classes of drivers/drvDisk.h, checked when the kernel is compiled) */
+#define IO_PRIO_INTERACTIVE 1
+#define IO_PRIO_BACKGROUND  2
+
+/* Set the I/O priority class of the calling process.
+   Return the previous class, or a negative number if an error ocurred.
+*/
+int IoPriority(int prio);
+
+/* Set the time quantum of the threads of the calling process, in
+   ticks: they are preempted when it is over, if another thread is
+   ready to run. 0 selects the quantum of the configuration.
+   Return the previous value, or a negative number if an error ocurred.
+*/
+int Quantum(int ticks);
+
+/* Scheduling priorities: the threads of higher priority run first.
+   Threads that compute for long are lowered, down to
+   SCHED_LOWEST_PRIORITY, and raised again when they wait for I/O,
+   but never above the priority of their process (the levels of
+   kernel/scheduler.h, checked when the kernel is compiled) */
+#define SCHED_HIGHEST_PRIORITY 0
+#define SCHED_LOWEST_PRIORITY  3
+
+/* Set the scheduling priority of the calling process.
+   Return the previous priority, or a negative number if an error ocurred.
+*/
+int Nice(int priority);
+
+/* Make the calling thread a periodic real-time thread: it runs ahead
+   of the other threads, earliest deadline first. Every period ticks,
+   a new job starts, which may use budget ticks of CPU and must end
+   (by calling Yield) before the next period. The thread is refused
+   if the total budget/period of the real-time threads would be over
+   100%. A period of 0 makes it a normal thread again.
+   Return 0, or a negative number if an error ocurred.
+*/
+int RealTime(int period, int budget);
+
+/* Weight of a process by default, and highest weight. With the Fair
+   thread scheduler, the CPU is shared between the processes in
+   proportion to their weight, then evenly between their threads
+   (WEIGHT_DEFAULT is the one of kernel/scheduler.h, checked when the
+   kernel is compiled) */
+#define WEIGHT_DEFAULT 1024
+#define WEIGHT_MAX     (1024*WEIGHT_DEFAULT)
+
+/* Set the weight of the calling process.
+   Return the previous weight, or a negative number if an error ocurred.
+*/
+int Weight(int weight);
+
+/* Put the calling thread to sleep for at least ticks ticks. The
+   thread is woken up at the first timer tick of the kernel after the
+   delay (a timer tick is 100 ticks).
+   Return 0, or a negative number if an error ocurred.
+*/
+int Sleep(int ticks);
+
+/* Register handler as the entry point of the user-level thread runtime
+   of the calling process (see greenRun in userlib/libnachos.h), and
+   start a kernel thread, called a virtual processor, running
+   handler(n) if none runs. At most one virtual processor of the
+   process runs user code at a time. When it blocks in the kernel,
+   another one that is back from a block takes over, or else a new one
+   is started at handler (upcall), so that the runtime can go on
+   running its other threads. A virtual processor back from a block
+   waits in the kernel until the running one blocks or exits. A
+   handler of 0 stops the upcalls.
+   Return 0, or a negative number if handler is not the address of an
+   instruction of the program.
+*/
+int Upcall(int handler);
+
 #endif // IN_ASM
 #endif // SYSCALL_H
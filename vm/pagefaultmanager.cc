@@ -12,6 +12,7 @@ Routines for the page fault managerPage Fault Manager
 #include "vm/swapManager.h"
 #include "vm/physMem.h"
 #include "vm/pagefaultmanager.h"
+#include "drivers/drvDisk.h"
 
 PageFaultManager::PageFaultManager() {
 }
@@ -66,6 +67,10 @@ ExceptionType PageFaultManager::PageFault(uint32_t virtualPage) {
     OpenFile* exec_file = process->exec_file;
     TranslationTable* translation_table = process->addrspace->translationTable;
 
+    // charge the disk requests below to the page fault
+    int io_origin = g_current_thread->GetIoOrigin();
+    g_current_thread->SetIoOrigin(DISK_ORIGIN_PAGEFAULT);
+
     // waiting until the page isn't used for a disk IO, then set the bit
     while (translation_table->getBitIo(virtualPage)) {
         g_current_thread->Yield();
@@ -89,12 +94,50 @@ ExceptionType PageFaultManager::PageFault(uint32_t virtualPage) {
         while (translation_table->getAddrDisk(virtualPage) == -1) {
             g_current_thread->Yield();
         }
-        g_swap_manager->GetPageSwap(
-            translation_table->getAddrDisk(virtualPage),
-            (char*) g_machine->mainMemory + pp*g_cfg->PageSize);
-        // release the swap sector
-        g_swap_manager->ReleasePageSwap(translation_table->getAddrDisk(virtualPage));
-        translation_table->clearBitSwap(virtualPage);
+        int sector = translation_table->getAddrDisk(virtualPage);
+
+        // read ahead the next virtual pages swapped out to the next
+        // sectors of the cluster, into free physical pages only:
+        // the whole cluster is one disk request
+        int frames[SWAP_CLUSTER_SIZE];
+        char *buffers[SWAP_CLUSTER_SIZE];
+        frames[0] = pp;
+        buffers[0] = (char*) g_machine->mainMemory + pp*g_cfg->PageSize;
+        int nb = 1;
+        int max = g_swap_manager->ContiguousPages(sector, SWAP_CLUSTER_SIZE);
+        while (nb < max) {
+            int page = virtualPage + nb;
+            if ((page >= translation_table->getMaxNumPages())
+                || !translation_table->getBitSwap(page)
+                || translation_table->getBitValid(page)
+                || translation_table->getBitIo(page)
+                || (translation_table->getAddrDisk(page) != sector + nb))
+                break;
+            int frame = g_physical_mem_manager->AddFreePhysicalToVirtualMapping(
+                process->addrspace, page);
+            if (frame == -1)
+                break;
+            translation_table->setBitIo(page);
+            frames[nb] = frame;
+            buffers[nb] = (char*) g_machine->mainMemory + frame*g_cfg->PageSize;
+            nb++;
+        }
+        g_swap_manager->GetPagesSwap(sector, buffers, nb);
+
+        // release the swap sectors
+        for (int i = 0; i < nb; i++) {
+            g_swap_manager->ReleasePageSwap(sector + i);
+            translation_table->clearBitSwap(virtualPage + i);
+        }
+        // the pages read ahead are ready (the faulting one is below)
+        for (int i = 1; i < nb; i++) {
+            DEBUG('v', "Page #%d read ahead from swap sector #%d.\n",
+                virtualPage + i, sector + i);
+            translation_table->clearBitIo(virtualPage + i);
+            translation_table->setBitValid(virtualPage + i);
+            translation_table->setPhysicalPage(virtualPage + i, frames[i]);
+            g_physical_mem_manager->UnlockPage(frames[i]);
+        }
     } else {
         if (translation_table->getAddrDisk(virtualPage) != -1) {
             DEBUG('v', "Page #%d is in exec file.\n", virtualPage);
@@ -116,6 +159,8 @@ ExceptionType PageFaultManager::PageFault(uint32_t virtualPage) {
     // unlock the page, ready to be used
     g_physical_mem_manager->UnlockPage((int)pp);
 
+    g_current_thread->SetIoOrigin(io_origin);
+
     return NO_EXCEPTION;
 #endif
 }
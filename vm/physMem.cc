@@ -177,6 +177,31 @@ int PhysicalMemManager::AddPhysicalToVirtualMapping(AddrSpace* owner,int virtual
 #endif
 }
 
+//-----------------------------------------------------------------
+// PhysicalMemManager::AddFreePhysicalToVirtualMapping
+//
+/*! This method returns a new physical page number if there is a free
+//  one, without evicting any page. Used to read pages ahead, which
+//  must not replace pages in use.
+//
+//  NB: the page is locked, as with AddPhysicalToVirtualMapping
+//
+//  \param owner address space (for backlink)
+//  \param virtualPage is the number of virtualPage to link with physical page
+//  \return A new physical page number, -1 if no page is free.
+*/
+//-----------------------------------------------------------------
+int PhysicalMemManager::AddFreePhysicalToVirtualMapping(AddrSpace* owner,int virtualPage) {
+    int pp = FindFreePage();
+    if (pp == -1)
+        return -1;
+    tpr[pp].free = false;
+    tpr[pp].locked = true;
+    tpr[pp].virtualPage = virtualPage;
+    tpr[pp].owner = owner;
+    return pp;
+}
+
 //-----------------------------------------------------------------
 // PhysicalMemManager::FindFreePage
 //
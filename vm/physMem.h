@@ -42,6 +42,7 @@ public:
   ~PhysicalMemManager();  //!< de-allocate the page_flags bitmap
 
   int AddPhysicalToVirtualMapping(AddrSpace* owner,int vp); //!< Finds a new page and adds a new page mapping
+  int AddFreePhysicalToVirtualMapping(AddrSpace* owner,int vp); //!< Same, only if a page is free (no eviction)
   void RemovePhysicalToVirtualMapping(long numPage); //!< Frees the page and deletes the existing page mapping
   void ChangeOwner(long numPage, Thread* owner);   //!< Change the page owner
   void UnlockPage(long numPage); //!< Unlock physical page
@@ -15,57 +15,185 @@
 #include "drivers/drvDisk.h"
 #include "utility/bitmap.h"
 #include "kernel/thread.h"
+#include "utility/config.h"
 #include "vm/swapManager.h"
 
 //-----------------------------------------------------------------
 /**
- * Initializes the swapping area
+ * Initializes the swap areas
  *
- * Initialize the page_flags bitmap to specify that the sectors
- * of the swapping area are free
+ * Build the list of swap areas declared in the configuration file
+ * (a single area covering the whole swap disk by default), and
+ * initialize their bitmaps to specify that all sectors are free
  */
 //-----------------------------------------------------------------
 SwapManager::SwapManager() {
 
-  swap_disk = new DriverDisk((char*)"sem swap disk",(char*)"lock swap disk",
-			     g_machine->diskSwap);
-  page_flags = new BitMap(NUM_SECTORS);
+  swap_disk = new DriverDisk((char*)"swap disk",g_machine->diskSwap);
 
+  // Read the swap areas from the configuration, inserting them
+  // by decreasing priority (areas of same priority keep the
+  // configuration order)
+  if (g_cfg->NbSwapAreas > MAX_SWAP_AREAS) {
+    printf("Too many swap areas (%d, at most %d)\n",
+	   g_cfg->NbSwapAreas,MAX_SWAP_AREAS);
+    exit(-1);
+  }
+  nb_areas = 0;
+  for (int i=0;i<g_cfg->NbSwapAreas;i++) {
+    int first = g_cfg->SwapAreaFirst[i];
+    int size = g_cfg->SwapAreaSize[i];
+    if ((first < 0) || (size <= 0) || (first+size > NUM_SECTORS)) {
+      printf("Invalid swap area #%d (sectors [%d,%d[ on a %d-sector disk)\n",
+	     i,first,first+size,NUM_SECTORS);
+      exit(-1);
+    }
+    for (int j=0;j<nb_areas;j++) {
+      if ((first < areas[j].first_sector+areas[j].nb_sectors)
+	  && (areas[j].first_sector < first+size)) {
+	printf("Swap area #%d (sectors [%d,%d[) overlaps sectors [%d,%d[\n",
+	       i,first,first+size,areas[j].first_sector,
+	       areas[j].first_sector+areas[j].nb_sectors);
+	exit(-1);
+      }
+    }
+    int pos = nb_areas;
+    while ((pos > 0) && (areas[pos-1].priority < g_cfg->SwapAreaPriority[i])) {
+      areas[pos] = areas[pos-1];
+      pos--;
+    }
+    areas[pos].disk = swap_disk;
+    areas[pos].first_sector = first;
+    areas[pos].nb_sectors = size;
+    areas[pos].priority = g_cfg->SwapAreaPriority[i];
+    nb_areas++;
+  }
+
+  // Default: the whole swap disk is a single area
+  if (nb_areas == 0) {
+    areas[0].disk = swap_disk;
+    areas[0].first_sector = 0;
+    areas[0].nb_sectors = NUM_SECTORS;
+    areas[0].priority = 0;
+    nb_areas = 1;
+  }
+
+  // Number the swap pages and initialize the areas
+  int base = 0;
+  for (int i=0;i<nb_areas;i++) {
+    areas[i].base = base;
+    areas[i].page_flags = new BitMap(areas[i].nb_sectors);
+    areas[i].next_free = 0;
+    areas[i].nb_used = 0;
+    areas[i].max_used = 0;
+    areas[i].nb_reads = 0;
+    areas[i].nb_writes = 0;
+    base += areas[i].nb_sectors;
+    stripe_area[i] = i;
+    stripe_count[i] = 0;
+  }
 }
 
 //-----------------------------------------------------------------
 /**
- * De-allocate the swapping area
+ * De-allocate the swap areas
  *
- * De-allocate the page_flags bitmap
+ * De-allocate the bitmaps and the swap disk driver
  */
 //-----------------------------------------------------------------
 SwapManager::~SwapManager() {
 
-  delete page_flags;
+  for (int i=0;i<nb_areas;i++)
+    delete areas[i].page_flags;
   delete swap_disk;
 
 }
 
+//-----------------------------------------------------------------
+/** Returns the swap area holding a page
+ *
+ * \param num_sector: global number of the page in the swap
+ */
+//-----------------------------------------------------------------
+SwapArea *SwapManager::FindArea(int num_sector) {
+
+  for (int i=0;i<nb_areas;i++) {
+    if ((num_sector >= areas[i].base)
+	&& (num_sector < areas[i].base + areas[i].nb_sectors))
+      return &areas[i];
+  }
+  ASSERT(false);
+  return NULL;
+}
+
+//-----------------------------------------------------------------
+/** Allocates a page in a given swap area
+ *
+ * The bitmap is scanned from the page following the last allocated
+ * one, so that the pages of a cluster are contiguous on the device
+ *
+ * \param area: the swap area to scan
+ * \return Number of the page, or -1 if the area is full
+ */
+//-----------------------------------------------------------------
+int SwapManager::GetFreePageInArea(SwapArea *area) {
+
+  for (int k=0;k<area->nb_sectors;k++) {
+    int i = (area->next_free + k) % area->nb_sectors;
+    if (! area->page_flags->Test(i)) {
+      // the page #i of the area is free
+      area->page_flags->Mark(i);
+      area->next_free = (i+1) % area->nb_sectors;
+      area->nb_used++;
+      if (area->nb_used > area->max_used)
+	area->max_used = area->nb_used;
+      return area->base + i;
+    }
+  }
+  return -1;
+}
+
 //-----------------------------------------------------------------
 /** Returns the number of a free page in the swap area
  *
- * This method scans the allocation bitmap page_flags to decide which
- * page is used
+ * This method looks for a free page in the group of areas of
+ * highest priority that still has free pages. Inside a group,
+ * clusters of SWAP_CLUSTER_SIZE pages are allocated round-robin
+ * over the areas, so that transfers to these areas can overlap
  *
  * \return Number of the found free page in the swap area, or -1 of
  * there is no page available
  */
 //-----------------------------------------------------------------
 int SwapManager::GetFreePage() {
-  
-  // Scan the page allocation bitmap
-  for (int i=0;i<NUM_SECTORS;i++) {
-    if (! page_flags->Test(i)) {
-      // the page #i is free
-      page_flags->Mark(i);
-      return i;
+
+  int first = 0;
+  while (first < nb_areas) {
+    // Areas [first,last] share the same priority
+    int last = first;
+    while ((last+1 < nb_areas)
+	   && (areas[last+1].priority == areas[first].priority))
+      last++;
+    int n = last - first + 1;
+
+    // Try the area of the current cluster first, then the next ones
+    for (int k=0;k<n;k++) {
+      int a = first + (stripe_area[first] - first + k) % n;
+      int page = GetFreePageInArea(&areas[a]);
+      if (page != -1) {
+	if (a != stripe_area[first]) {
+	  stripe_area[first] = a;
+	  stripe_count[first] = 0;
+	}
+	// Move to the next area once the cluster is complete
+	if (++stripe_count[first] == SWAP_CLUSTER_SIZE) {
+	  stripe_area[first] = first + (a - first + 1) % n;
+	  stripe_count[first] = 0;
+	}
+	return page;
+      }
     }
+    first = last + 1;
   }
 
   // There is no available page, return -1
@@ -84,8 +212,10 @@ void SwapManager::ReleasePageSwap(int num_sector) {
 
   DEBUG('v',(char *)"Swap page %i released for thread \"%s\"\n",num_sector,
 	g_current_thread->GetName());
-  // clear the #num_sector bit of page_flags
-  page_flags->Clear(num_sector);
+  // clear the bit of the page in the bitmap of its area
+  SwapArea *area = FindArea(num_sector);
+  area->page_flags->Clear(num_sector - area->base);
+  area->nb_used--;
 
 }
 
@@ -100,13 +230,55 @@ void SwapManager::GetPageSwap(int num_sector ,char* SwapPage ) {
   
   DEBUG('v',(char *)"Reading swap page %i for \"%s\"\n",num_sector,
 	g_current_thread->GetName());
-  swap_disk->ReadSector(num_sector,SwapPage);
+  SwapArea *area = FindArea(num_sector);
+  area->nb_reads++;
+  area->disk->ReadSector(area->first_sector + num_sector - area->base,
+			 SwapPage);
+}
+
+//-----------------------------------------------------------------
+/** Fill buffers with consecutive pages of one swap area. The pages
+ *  are read by a single vectored request on the device of the area.
+ *
+ * \param num_sector: sector number of the first page in the swap area
+ * \param SwapPages: buffers where to put the pages, one per page
+ * \param nb_pages: number of pages, all in the area of num_sector
+ */
+//-----------------------------------------------------------------
+void SwapManager::GetPagesSwap(int num_sector, char **SwapPages,
+			       int nb_pages) {
+
+  DEBUG('v',(char *)"Reading swap pages [%i,%i[ for \"%s\"\n",num_sector,
+	num_sector+nb_pages,g_current_thread->GetName());
+  SwapArea *area = FindArea(num_sector);
+  ASSERT(num_sector + nb_pages <= area->base + area->nb_sectors);
+  area->nb_reads += nb_pages;
+  area->disk->ReadSectors(area->first_sector + num_sector - area->base,
+			  SwapPages, nb_pages);
+}
+
+//-----------------------------------------------------------------
+/** Returns how many pages, at most nb_pages, follow a page in its
+ *  swap area, the page included
+ *
+ * \param num_sector: sector number of the page in the swap area
+ * \param nb_pages: maximum number of pages
+ */
+//-----------------------------------------------------------------
+int SwapManager::ContiguousPages(int num_sector, int nb_pages) {
+
+  SwapArea *area = FindArea(num_sector);
+  int left = area->base + area->nb_sectors - num_sector;
+  return (left < nb_pages) ? left : nb_pages;
 }
 
 //-----------------------------------------------------------------
 /** This method puts a page into the swapping area. If the sector
  *  number given in parameters is set to -1, the swap manager
  *  chooses a free sector and return its number.
+ *  The page is copied and written behind: the caller does not wait
+ *  for the disk, and a later read of the page is served from the
+ *  pending write.
  *  
  *  \param num_sector is the sector number used in the swapping area,
  *  \param SwapPage is the buffer to transfer in the swapping area.
@@ -117,24 +289,19 @@ void SwapManager::GetPageSwap(int num_sector ,char* SwapPage ) {
 //-----------------------------------------------------------------
 int SwapManager::PutPageSwap(int num_sector,char *SwapPage) {
 
-  if (num_sector >= 0) {
-    DEBUG('v',(char *)"Writing swap page %i for \"%s\"\n",num_sector,
-	    g_current_thread->GetName());
-    swap_disk->WriteSector(num_sector,SwapPage);
-    return num_sector;
-  }
-  else {
-    int newpage = GetFreePage();
-    if (newpage == -1) {
+  if (num_sector < 0) {
+    num_sector = GetFreePage();
+    if (num_sector == -1) {
       return -1;
     }
-    else {
-      DEBUG('v',(char *)"Writing swap page %i for \"%s\"\n",newpage,
-	    g_current_thread->GetName());
-      swap_disk->WriteSector(newpage,SwapPage);
-      return newpage;
-    }
-  }		 
+  }
+  DEBUG('v',(char *)"Writing swap page %i for \"%s\"\n",num_sector,
+	g_current_thread->GetName());
+  SwapArea *area = FindArea(num_sector);
+  area->nb_writes++;
+  area->disk->WriteBehind(area->first_sector + num_sector - area->base,
+			  SwapPage, DISK_ORIGIN_SWAPOUT);
+  return num_sector;
 }
 
 //-----------------------------------------------------------------
@@ -144,3 +311,19 @@ DriverDisk * SwapManager::GetSwapDisk ()
 {
   return swap_disk;
 }   
+
+//-----------------------------------------------------------------
+/** Print the utilization of each swap area */
+//-----------------------------------------------------------------
+void SwapManager::Print() {
+
+  printf("Swap areas:\n");
+  for (int i=0;i<nb_areas;i++) {
+    printf("  area %d: priority %d, sectors [%d,%d[, used %d/%d (peak %d), "
+	   "%d reads, %d writes\n",
+	   i,areas[i].priority,
+	   areas[i].first_sector,areas[i].first_sector+areas[i].nb_sectors,
+	   areas[i].nb_used,areas[i].nb_sectors,areas[i].max_used,
+	   areas[i].nb_reads,areas[i].nb_writes);
+  }
+}
@@ -22,6 +22,37 @@ class DriverDisk;
 class BitMap;
 class OpenFile;
 
+/*! Maximum number of swap areas that can be declared in the
+    configuration file */
+#define MAX_SWAP_AREAS 8
+
+/*! Number of consecutive pages allocated in a swap area before the
+    allocator moves on to the next area of the same priority */
+#define SWAP_CLUSTER_SIZE 8
+
+//-----------------------------------------------------------------
+/*! \brief Describes one swap area
+  
+   A swap area is a range of sectors on a swap device. Pages of the
+   swap are numbered globally: area i holds the swap pages
+   [base, base+nb_sectors[, which are stored in the sectors
+   [first_sector, first_sector+nb_sectors[ of its device.
+*/
+//-----------------------------------------------------------------
+typedef struct {
+  DriverDisk *disk;    //!< Driver of the device holding the area
+  int first_sector;    //!< First sector of the area on its device
+  int nb_sectors;      //!< Size of the area, in sectors
+  int base;            //!< Global number of the first page of the area
+  int priority;        //!< Areas of higher priority are filled first
+  BitMap *page_flags;  //!< Allocation bitmap of the area
+  int next_free;       //!< Where to start the next bitmap scan
+  int nb_used;         //!< Number of pages currently allocated
+  int max_used;        //!< Highest value ever reached by nb_used
+  int nb_reads;        //!< Number of pages read from the area
+  int nb_writes;       //!< Number of pages written to the area
+} SwapArea;
+
 //-----------------------------------------------------------------
 /*! \brief Implements the swap manager
   
@@ -32,6 +63,11 @@ class OpenFile;
      - save a page from a buffer to the swapping area, 
      - restore a page from the swapping area to a buffer,
      - release an unused page in the swapping area,
+
+   The swap is made of one or several swap areas (see the SwapArea
+   entries of the configuration file). Areas with the highest
+   priority are filled first, and consecutive clusters of pages are
+   striped round-robin over the areas sharing the same priority.
 */
 //-----------------------------------------------------------------
 
@@ -39,17 +75,18 @@ class SwapManager {
 public:
 
   /**
-   * Initializes the swapping area
+   * Initializes the swap areas
    *
-   * Initialize the page_flags bitmap to specify that the sectors
-   * of the swapping area are free
+   * Build the list of swap areas declared in the configuration file
+   * (a single area covering the whole swap disk by default), and
+   * initialize their bitmaps to specify that all sectors are free
    */
   SwapManager();
 
   /**
-   * De-allocate the swapping area
+   * De-allocate the swap areas
    *
-   * De-allocate the page_flags bitmap
+   * De-allocate the bitmaps and the swap disk driver
    */
   ~SwapManager(); 
   
@@ -60,6 +97,21 @@ public:
    */
   void GetPageSwap(int num_sector,char* Swap_Page);   
 
+  /** Fill buffers with consecutive pages of one swap area, read as
+   *  a single disk request
+   *
+   * \param num_sector: sector number of the first page in the swap area
+   * \param SwapPages: buffers where to put the pages, one per page
+   * \param nb_pages: number of pages (see ContiguousPages)
+   */
+  void GetPagesSwap(int num_sector, char **SwapPages, int nb_pages);
+
+  /** Returns how many pages, at most nb_pages, follow num_sector in
+   *  its swap area (num_sector included): these can be read by a
+   *  single GetPagesSwap
+   */
+  int ContiguousPages(int num_sector, int nb_pages);
+
   /** This method puts a page into the swapping area. If the sector
    *  number given in parameters is set to -1, the swap manager
    *  chooses a free sector and return its number.
@@ -83,23 +135,52 @@ public:
   /** This method gives access to the swapdisk's driver */
   DriverDisk * GetSwapDisk ();   
 
+  /** Print the utilization of each swap area */
+  void Print();
+
 private:
 
-  /** Disk containing the swap area */
+  /** Disk containing the swap areas */
   DriverDisk *swap_disk;
 
-  /** Bitmap used to know if sectors in the swap area are free or busy */
-  BitMap *page_flags; 
+  /** Swap areas, sorted by decreasing priority */
+  SwapArea areas[MAX_SWAP_AREAS];
+
+  /** Number of swap areas */
+  int nb_areas;
+
+  /** Index of the area receiving the current cluster, for each
+      group of areas of same priority (indexed by the first area of
+      the group) */
+  int stripe_area[MAX_SWAP_AREAS];
+
+  /** Number of pages already allocated in the current cluster, for
+      each group of areas of same priority */
+  int stripe_count[MAX_SWAP_AREAS];
 
   /** Returns the number of a free page in the swap area
    *
-   * This method scans the allocation bitmap page_flags to decide which
-   * page is used
+   * This method looks for a free page in the group of areas of
+   * highest priority that still has free pages, striping clusters of
+   * SWAP_CLUSTER_SIZE pages over the areas of the group
    *
    * \return Number of the found free page in the swap area, or -1 of
    * there is no page available
    */
   int GetFreePage();
+
+  /** Allocates a page in a given swap area
+   *
+   * \param area: the swap area to scan
+   * \return Number of the page, or -1 if the area is full
+   */
+  int GetFreePageInArea(SwapArea *area);
+
+  /** Returns the swap area holding a page
+   *
+   * \param num_sector: global number of the page in the swap
+   */
+  SwapArea *FindArea(int num_sector);
 };
 
 #endif // __SWAPMGR_H